@@ -6,20 +6,25 @@
 #define HEAPSTER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-// I wanted to make the header file compatible with cpp but I do not think it works with cpp (did not try)
+// usable from C++ as well, heapster.hpp builds the allocator and pmr adaptor on top of it
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /*
-    User can choose from different block selection strategies
+    User can choose from different block selection strategies. ADAPTIVE lets
+    every arena measure its own search length, fragmentation and waste and
+    switch between the other four at runtime; the choice and the number of
+    switches show up in heapster_status.
 */
 typedef enum {
     HEAPSTER_FIRST_FIT     = 0,
     HEAPSTER_NEXT_FIT      = 1,
     HEAPSTER_BEST_FIT      = 2,
-    HEAPSTER_WORST_FIT     = 3
+    HEAPSTER_WORST_FIT     = 3,
+    HEAPSTER_ADAPTIVE      = 4
 } heapster_policy_t;
 
 void *heapster_malloc(size_t size);
@@ -30,10 +35,343 @@ void *heapster_calloc(size_t nmemb, size_t size);
 void heapster_set_policy(heapster_policy_t policy);
 heapster_policy_t heapster_get_policy(void);
 
+/*
+    Huge page backing for large mmap arenas (>= 2 MiB). THP aligns the arena
+    to 2 MiB and applies madvise(MADV_HUGEPAGE), HUGETLB tries MAP_HUGETLB first
+    and falls back to THP when no hugetlbfs pages are reserved.
+*/
+typedef enum {
+    HEAPSTER_HUGE_OFF      = 0,
+    HEAPSTER_HUGE_THP      = 1,
+    HEAPSTER_HUGE_HUGETLB  = 2
+} heapster_huge_mode_t;
+
+void heapster_set_huge_pages(heapster_huge_mode_t mode);
+heapster_huge_mode_t heapster_get_huge_pages(void);
+
+/*
+    NUMA mode: arenas are bound to the node of the thread that creates them and
+    malloc only picks arenas on the caller's current node. On single node or
+    non-Linux systems it compiles and behaves like the normal allocator.
+*/
+void heapster_set_numa(int enabled);
+int heapster_get_numa(void);
+
 void heapster_set_mmap_threshold(size_t bytes);
 size_t heapster_get_mmap_threshold(void);
 
-// int heapster_init(size_t arena_size, heapster_policy_t policy);
+/*
+    Deferred coalescing: small freed blocks are parked in exact-size quick lists
+    instead of being merged, and merged in batches later. The global switch sets
+    the default for arenas created afterwards, the per arena switch changes the
+    arena that owns ptr (disabling it merges the parked blocks right away).
+*/
+void heapster_set_deferred_coalescing(int enabled);
+int heapster_get_deferred_coalescing(void);
+int heapster_arena_set_deferred_coalescing(void *ptr, int enabled);
+
+/*
+    Arena lock flavour. MUTEX is a plain pthread mutex, ADAPTIVE (default) spins
+    with exponential backoff before sleeping on a futex, TICKET is a FIFO ticket
+    lock for fairness under heavy contention. Applies to arenas created after
+    the call. Contention count and wait time show up in heapster_status.
+*/
+typedef enum {
+    HEAPSTER_LOCK_MUTEX    = 0,
+    HEAPSTER_LOCK_ADAPTIVE = 1,
+    HEAPSTER_LOCK_TICKET   = 2
+} heapster_lock_kind_t;
+
+void heapster_set_lock_kind(heapster_lock_kind_t kind);
+heapster_lock_kind_t heapster_get_lock_kind(void);
+
+/*
+    Bounded latency mode for soft real-time threads. heapster_rt_reserve maps one
+    pool up front, prefaults it and mlocks it. Threads that call
+    heapster_rt_enable(1) allocate from that pool with an O(1) two-level
+    segregated fit (TLSF) lookup and no syscalls; when the pool is exhausted
+    malloc returns NULL instead of growing. Pool pointers can be freed from any
+    thread. Returns 0 on success, -1 on failure or if a pool already exists.
+*/
+int heapster_rt_reserve(size_t bytes);
+void heapster_rt_enable(int enabled);
+int heapster_rt_enabled(void);
+
+/*
+    Heap integrity checks. HEADERS arms a checksum over each block header and
+    catches double frees, CANARIES also writes a trailing canary after the
+    requested bytes and reports overruns on free. Corrupted blocks are reported
+    and leaked instead of being freed. sample_rate N arms one allocation in N
+    per thread (1 = all) to keep the cost low in production; OFF costs one
+    branch per call. heapster_check_heap walks every block of every arena and
+    returns the number of problems found (also printed to stderr).
+*/
+typedef enum {
+    HEAPSTER_CHECK_OFF      = 0,
+    HEAPSTER_CHECK_HEADERS  = 1,
+    HEAPSTER_CHECK_CANARIES = 2
+} heapster_check_level_t;
+
+void heapster_set_check_level(heapster_check_level_t level, unsigned sample_rate);
+heapster_check_level_t heapster_get_check_level(void);
+unsigned heapster_get_check_sample_rate(void);
+int heapster_check_heap(void);
+
+/*
+    Sampling heap profiler. Once started, each thread samples one allocation
+    every sample_bytes allocated on average, records its backtrace and keeps
+    it as live until it is freed. heapster_profile_dump writes the live bytes
+    per call stack in collapsed stack format ("root;...;leaf bytes", readable
+    by flamegraph.pl, speedscope and pprof) to path, or stderr when path is
+    NULL. heapster_profile_dump_on_signal does the same whenever signo arrives
+    (default path heapster.<pid>.folded). Unsampled allocations only pay for a
+    thread-local counter decrement. Link with -rdynamic to get symbol names
+    for functions of the executable. Return 0 on success, -1 on failure.
+*/
+int heapster_profile_start(size_t sample_bytes);
+void heapster_profile_stop(void);
+size_t heapster_profile_get_sample_bytes(void);
+int heapster_profile_dump(const char *path);
+int heapster_profile_dump_on_signal(int signo, const char *path);
+
+/*
+    Large copies and zeroing. The realloc copy and the calloc zeroing use
+    non-temporal (streaming) stores once they reach threshold bytes, so
+    multi megabyte buffers do not evict the caller's working set; the AVX2
+    or SSE2 kernel is picked at runtime (x86_64 only, 0 turns it off). When
+    the old and new block both live in mmapped arenas, realloc moves whole
+    pages with mremap instead of copying them.
+*/
+void heapster_set_nontemporal_threshold(size_t bytes);
+size_t heapster_get_nontemporal_threshold(void);
+
+/*
+    Size classes and the thread cache. Small payloads are rounded up to a
+    multiple of HEAPSTER_ALIGNMENT; class c holds (c + 1) * HEAPSTER_ALIGNMENT
+    bytes. Each thread keeps up to tcache_count freed blocks per class of the
+    default heap and hands them back to the next malloc of that class without
+    taking any lock (heapster_tcache_flush returns them to their arenas, a
+    thread does it on exit). HEAPSTER_SIZE_CLASS folds to a constant for a
+    constant size, heapster_malloc_class then skips the rounding and goes
+    straight to the cache; heapster_inline.h and heapster.hpp wrap this for
+    sizeof(T) call sites. heapster_size_class returns -1 for sizes that are
+    not cached.
+*/
+#ifdef __cplusplus
+#define HEAPSTER_ALIGNMENT alignof(max_align_t)
+#else
+#define HEAPSTER_ALIGNMENT _Alignof(max_align_t)
+#endif
+#define HEAPSTER_SIZE_CLASSES 32
+#define HEAPSTER_SIZE_CLASS(n) \
+    ((n) > 0 && (n) <= HEAPSTER_SIZE_CLASSES * HEAPSTER_ALIGNMENT \
+        ? (int)(((n) + HEAPSTER_ALIGNMENT - 1) / HEAPSTER_ALIGNMENT) - 1 : -1)
+
+int heapster_size_class(size_t size);
+void *heapster_malloc_class(int size_class);
+void heapster_tcache_flush(void);
+void heapster_set_tcache_count(unsigned count);
+unsigned heapster_get_tcache_count(void);
+
+/*
+    Deferred free for latency critical threads. heapster_free_deferred only
+    queues the pointer in a per-thread chain without taking any lock; full
+    chains are handed to a background reclaimer thread that does the real
+    frees in batches, one arena lock per arena. With deferred_thread off the
+    queue waits for heapster_deferred_flush, which pushes the calling
+    thread's chain and frees everything queued on the calling thread (call
+    it when idle). Once deferred_max_bytes are queued further calls free
+    right away (0 = never defer). A queued pointer must not be freed again.
+    heapster_heap_destroy flushes the queue first and refuses to destroy a
+    heap while other threads still hold its pointers in their chains; those
+    threads must call heapster_deferred_flush. Blocks of shared heaps are
+    freed right away.
+*/
+void heapster_free_deferred(void *ptr);
+void heapster_deferred_flush(void);
+void heapster_set_deferred_max_bytes(size_t bytes);
+size_t heapster_get_deferred_max_bytes(void);
+void heapster_set_deferred_thread(int enabled);
+int heapster_get_deferred_thread(void);
+
+/*
+    Configuration. Start from heapster_config_default (which also applies the
+    HEAPSTER_CONF environment variable, e.g.
+    HEAPSTER_CONF="initial_arena_size:1M,growth_factor:2,policy:best_fit")
+    and pass it to heapster_init_with_config. Without an explicit init the
+    defaults plus HEAPSTER_CONF are applied on the first malloc.
+*/
+typedef struct {
+    size_t arena_count;          // arenas created up front by init
+    size_t initial_arena_size;   // minimum size of a new arena, first growth step
+    size_t max_arena_size;       // growth stops here (0 = unbounded), larger requests still get their own arena
+    double growth_factor;        // each new arena step is the previous one times this (>= 1.0)
+    size_t mmap_threshold;       // arenas at least this big come from mmap instead of sbrk
+    size_t quick_max_size;       // largest payload parked in the quick lists with deferred coalescing
+    size_t quick_consolidate_threshold; // parked blocks that trigger a batch merge
+    unsigned purge_decay_ms;     // return free pages of an arena to the OS at most this often (0 = off)
+    heapster_policy_t policy;
+    heapster_check_level_t check_level; // integrity checks on malloc/free (off, headers, canaries)
+    unsigned check_sample_rate;  // arm one allocation in this many per thread (1 = all)
+    size_t profile_sample_bytes; // start the sampling profiler with this interval (0 = off)
+    int profile_signal;          // dump the profile when this signal arrives (0 = none)
+    size_t nontemporal_threshold; // copies and zeroing this big use streaming stores (0 = off)
+    unsigned tcache_count;       // freed small blocks each thread keeps per size class (0 = off)
+    size_t deferred_max_bytes;   // bytes heapster_free_deferred may queue (0 = free right away)
+    int deferred_thread;         // a background thread does the deferred frees (0 = only on flush)
+    size_t soft_limit;           // arena bytes that trigger the pressure callback and a trim (0 = none)
+    size_t hard_limit;           // arena bytes the heap never maps beyond (0 = none)
+} heapster_config_t;
+
+void heapster_config_default(heapster_config_t *cfg);
+int heapster_init_with_config(const heapster_config_t *cfg);
+void heapster_get_config(heapster_config_t *cfg);
+
+int heapster_init(size_t arena_size, heapster_policy_t policy);
+
+/*
+    Reserve and prefault bytes of heap at startup, split into arenas of
+    max_arena_size. With threads <= 1 the pages are populated by mmap
+    (MAP_POPULATE), otherwise that many threads touch them in parallel.
+    malloc uses reserved arenas before creating new ones and they are never
+    unmapped or purged before heapster_finalize. Returns 0 or -1.
+*/
+int heapster_reserve(size_t bytes, unsigned threads);
+
+/*
+    Independent heaps. Each heap has its own arenas, policy, thresholds and
+    stats, so a noisy subsystem does not fragment or contend with a latency
+    critical one. cfg may be NULL for the built-in defaults; the check_*,
+    profile_*, nontemporal_threshold, tcache_count and deferred_* fields are process wide
+    and ignored here. A NULL heap means the
+    default heap used by heapster_malloc. Pointers can be released with
+    heapster_heap_free or plain heapster_free, realloc keeps them in their
+    heap. Arenas of a created heap are always mmapped: destroying the heap
+    unmaps all of them at once and invalidates every pointer it handed out.
+*/
+typedef struct heapster_heap heapster_heap_t;
+
+heapster_heap_t *heapster_heap_create(const heapster_config_t *cfg);
+void heapster_heap_destroy(heapster_heap_t *heap);
+void *heapster_heap_malloc(heapster_heap_t *heap, size_t size);
+void *heapster_heap_calloc(heapster_heap_t *heap, size_t nmemb, size_t size);
+void *heapster_heap_realloc(heapster_heap_t *heap, void *ptr, size_t size);
+void heapster_heap_free(heapster_heap_t *heap, void *ptr);
+void heapster_heap_set_policy(heapster_heap_t *heap, heapster_policy_t policy);
+heapster_policy_t heapster_heap_get_policy(heapster_heap_t *heap);
+void heapster_heap_status(heapster_heap_t *heap);
+
+/*
+    Memory budgets. A heap counts the bytes of all its arenas (the sum of
+    their total_bytes); the count only changes when an arena is mapped or
+    returned, so it costs nothing per malloc. Past hard_limit no new arena
+    is mapped: malloc fails without a syscall once the existing arenas are
+    full. Crossing soft_limit upwards calls the pressure callback from the
+    allocating thread outside of any heapster lock, so it may free or trim,
+    and then trims the heap itself. The first malloc that fails at the hard
+    limit calls it too (without the trim), again only after the heap has
+    returned an arena.
+    heapster_heap_trim releases empty arenas and purges free pages, and
+    returns the bytes given back. 0 means no limit; a NULL heap is the
+    default heap.
+*/
+typedef enum {
+    HEAPSTER_PRESSURE_SOFT = 1,
+    HEAPSTER_PRESSURE_HARD = 2
+} heapster_pressure_t;
+
+typedef void (*heapster_pressure_fn)(heapster_heap_t *heap, int level, size_t mapped, size_t limit, void *arg);
+
+void heapster_heap_set_limits(heapster_heap_t *heap, size_t soft_limit, size_t hard_limit);
+void heapster_heap_get_limits(heapster_heap_t *heap, size_t *soft_limit, size_t *hard_limit);
+size_t heapster_heap_mapped_bytes(heapster_heap_t *heap);
+void heapster_heap_set_pressure_callback(heapster_heap_t *heap, heapster_pressure_fn fn, void *arg);
+size_t heapster_heap_trim(heapster_heap_t *heap);
+
+/*
+    Persistent heaps. heapster_heap_open_file maps a heap from path, creating
+    a size byte file if it does not exist. An existing file is checked block
+    by block and its allocations are usable right away, at the address they
+    had before when base is NULL and that range is free (otherwise anywhere;
+    a non-NULL base must be honoured or the open fails). Raw pointers stored
+    inside the heap only survive a reopen at the same address, the root
+    (heapster_heap_set_root / heapster_heap_get_root) is stored as an offset
+    and always does. The heap never grows: malloc returns NULL once the file
+    is full. heapster_heap_sync writes a consistent checkpoint to disk,
+    heapster_heap_destroy syncs and closes it. A forked child loses access
+    to the file heaps of its parent.
+*/
+heapster_heap_t *heapster_heap_open_file(const char *path, size_t size, void *base);
+int heapster_heap_sync(heapster_heap_t *heap);
+int heapster_heap_set_root(heapster_heap_t *heap, void *ptr);
+void *heapster_heap_get_root(heapster_heap_t *heap);
+
+/*
+    Shared heaps. heapster_heap_create_shared places a fixed size heap in
+    shared memory (shm_open(name) when name is given, an anonymous memfd
+    otherwise) that several processes can malloc and free from through the
+    usual heapster_heap_* calls. Other processes join with
+    heapster_heap_attach_shared, by name or by an fd received over a unix
+    socket (heapster_heap_shared_fd); forked children already share it. The
+    heap is mapped at the creator's address in every process, an attach
+    fails if that range is taken. Hand buffers over as offsets
+    (heapster_heap_to_offset / heapster_heap_from_offset, which also work
+    for file heaps, 0 = not in the heap). heapster_heap_detach_shared (or
+    heapster_heap_destroy) unmaps it in this process only; a named heap
+    lives until shm_unlink(name).
+*/
+heapster_heap_t *heapster_heap_create_shared(const char *name, size_t size);
+heapster_heap_t *heapster_heap_attach_shared(const char *name, int fd);
+void heapster_heap_detach_shared(heapster_heap_t *heap);
+int heapster_heap_shared_fd(heapster_heap_t *heap);
+size_t heapster_heap_to_offset(heapster_heap_t *heap, const void *ptr);
+void *heapster_heap_from_offset(heapster_heap_t *heap, size_t offset);
+
+/*
+    Handle heaps. heapster_heap_create_handles reserves one contiguous range
+    of up to 64 GiB (0 = the maximum) and hands out 32 bit handles instead
+    of pointers, halving the size of links in pointer heavy structures. A
+    handle is the offset from heapster_handle_base in HEAPSTER_ALIGNMENT
+    units, heapster_handle_ptr turns it back into a pointer with one
+    multiply and add. 0 is the null handle and what heapster_handle_malloc
+    returns when the heap is full; it never grows. Pointers from
+    heapster_heap_malloc on the same heap convert with heapster_handle_of.
+    Memory is committed on first touch and given back by
+    heapster_heap_destroy.
+*/
+typedef uint32_t heapster_handle_t;
+
+heapster_heap_t *heapster_heap_create_handles(size_t size);
+void *heapster_handle_base(heapster_heap_t *heap);
+heapster_handle_t heapster_handle_malloc(heapster_heap_t *heap, size_t size);
+heapster_handle_t heapster_handle_calloc(heapster_heap_t *heap, size_t nmemb, size_t size);
+void heapster_handle_free(heapster_heap_t *heap, heapster_handle_t handle);
+heapster_handle_t heapster_handle_of(heapster_heap_t *heap, const void *ptr);
+
+static inline void *heapster_handle_ptr(const void *base, heapster_handle_t handle) {
+    return (char *)base + (size_t)handle * HEAPSTER_ALIGNMENT;
+}
+
+/*
+    Lifetime hints. heapster_malloc_hint routes the request to an internal heap
+    kept for that kind of object, so one long-lived survivor does not pin an
+    arena full of short-lived buffers. SHORT_LIVED uses small first fit
+    arenas that empty and get released quickly, LONG_LIVED packs objects
+    densely with best fit into large arenas, LARGE_STREAMING gives each big
+    buffer its own mapping that is unmapped on free. If several hints are set
+    LARGE_STREAMING wins over LONG_LIVED, which wins over SHORT_LIVED; no hint
+    is the same as heapster_malloc. The result is freed and resized with the
+    usual heapster_free / heapster_realloc.
+*/
+typedef enum {
+    HEAPSTER_HINT_NONE            = 0,
+    HEAPSTER_HINT_SHORT_LIVED     = 1 << 0,
+    HEAPSTER_HINT_LONG_LIVED      = 1 << 1,
+    HEAPSTER_HINT_LARGE_STREAMING = 1 << 2
+} heapster_hint_t;
+
+void *heapster_malloc_hint(size_t size, unsigned hints);
+
 int heapster_finalize(void);
 
 void heapster_status(void);
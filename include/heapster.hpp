@@ -0,0 +1,124 @@
+/*
+ * heapster.hpp — C++ allocator and memory_resource on top of heapster
+ */
+
+#ifndef HEAPSTER_HPP
+#define HEAPSTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "heapster.h"
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define HEAPSTER_HAS_PMR 1
+#endif
+#endif
+
+namespace heapster {
+
+/*
+    size_class<N>::value is the size class of an N byte payload, -1 when N is
+    too big for the thread cache. allocate<N>() uses it at compile time.
+*/
+template <std::size_t N>
+struct size_class {
+    static constexpr int value = HEAPSTER_SIZE_CLASS(N);
+};
+
+template <std::size_t N>
+inline void *allocate() noexcept {
+    return size_class<N>::value >= 0 ? heapster_malloc_class(size_class<N>::value) : heapster_malloc(N);
+}
+
+/*
+    Standard allocator on the default heap. Single objects (what node based
+    containers allocate) take the compile time size class path, arrays go
+    through heapster_malloc. Types aligned beyond HEAPSTER_ALIGNMENT are
+    rejected at compile time. Throws std::bad_alloc when the heap is full.
+*/
+template <class T>
+class allocator {
+public:
+    using value_type = T;
+
+    allocator() noexcept = default;
+
+    template <class U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        static_assert(alignof(T) <= HEAPSTER_ALIGNMENT, "heapster::allocator: over-aligned type");
+
+        void *ptr;
+        if (n == 1) {
+            ptr = heapster::allocate<sizeof(T)>();
+        } else {
+            if (n > SIZE_MAX / sizeof(T)) {
+                throw std::bad_alloc();
+            }
+            ptr = heapster_malloc(n ? n * sizeof(T) : 1);
+        }
+
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T *ptr, std::size_t) noexcept {
+        heapster_free(ptr);
+    }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept {
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept {
+    return false;
+}
+
+#ifdef HEAPSTER_HAS_PMR
+/*
+    std::pmr adaptor for the default heap, e.g.
+    std::pmr::vector<int> v(heapster::resource()). Alignments above
+    HEAPSTER_ALIGNMENT throw std::bad_alloc. All instances are
+    interchangeable.
+*/
+class memory_resource : public std::pmr::memory_resource {
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (alignment > HEAPSTER_ALIGNMENT) {
+            throw std::bad_alloc();
+        }
+        void *ptr = heapster_malloc(bytes ? bytes : 1);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void do_deallocate(void *ptr, std::size_t, std::size_t) override {
+        heapster_free(ptr);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return dynamic_cast<const memory_resource *>(&other) != nullptr;
+    }
+};
+
+inline memory_resource *resource() noexcept {
+    static memory_resource instance;
+    return &instance;
+}
+#endif
+
+} // namespace heapster
+
+#endif // HEAPSTER_HPP
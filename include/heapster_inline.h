@@ -0,0 +1,28 @@
+/*
+ * heapster_inline.h — fast paths for allocation sizes known at compile time
+ */
+
+#ifndef HEAPSTER_INLINE_H
+#define HEAPSTER_INLINE_H
+
+#include "heapster.h"
+
+/*
+    heapster_malloc_fast(n) is heapster_malloc(n), except that for a constant
+    n that fits a size class (sizeof(T), a literal) the class is computed by
+    the compiler and the call goes straight to heapster_malloc_class, i.e.
+    the calling thread's cache. n is evaluated once. heapster_new(T)
+    allocates one uninitialised T. Compilers without __builtin_constant_p
+    always take the heapster_malloc path. Free with heapster_free as usual.
+*/
+#if defined(__GNUC__) || defined(__clang__)
+#define heapster_malloc_fast(n) \
+    (__builtin_constant_p(n) && HEAPSTER_SIZE_CLASS(n) >= 0 \
+        ? heapster_malloc_class(HEAPSTER_SIZE_CLASS(n)) : heapster_malloc(n))
+#else
+#define heapster_malloc_fast(n) heapster_malloc(n)
+#endif
+
+#define heapster_new(T) ((T *)heapster_malloc_fast(sizeof(T)))
+
+#endif // HEAPSTER_INLINE_H
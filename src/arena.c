@@ -1,26 +1,19 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "internal.h"
 #include "heapster.h"
 #include "internal_f.h"
 
-// inside the source code user can access the arenas with arena_get_list() method
-static arena_t *arena_list_head = NULL; 
+// arena listesi, retired listesi ve arena ayarlari heap basina (struct heapster_heap, internal.h).
+// heapster_malloc'un kullandigi varsayilan heap heap.c'de, kod icinden arena_get_list(heap) ile gezilir
 
+// buyuk mmap arenalari huge page ile desteklensin mi, varsayilan kapali
+static heapster_huge_mode_t huge_page_mode = HEAPSTER_HUGE_OFF;
 
-pthread_mutex_t arena_list_lock = PTHREAD_MUTEX_INITIALIZER;
-
-// if user wanted size is less then this use sbrk to increase end of heap.
-static size_t mmap_threshold = 128 * 1024; 
-/*
-arena create'nin parametresi size bu sizedan 
-az ise sbrk fazla ya da esit ise mmap kullanilir
-getter ve setter methodlar ile disaridan erisilebilir
-*/
-
-static uint64_t arena_id_counter = 1;  
+static _Atomic uint64_t arena_id_counter = 1;  // arenalar kilitsiz olusturulabilir, id cakismasin diye atomic
 /* 
 tek amacım her arenaya farklı id gitmesidir silinen 
 arena icin totalden idleri degistirmek gibi bir 
@@ -29,16 +22,218 @@ amacım yok ondan sadece increment ve bence int (
 deger yapar
 */
 
+/*
+if user wanted size is less then this use sbrk to increase end of heap.
+arena create'nin parametresi size bu sizedan az ise sbrk fazla ya da esit ise mmap kullanilir.
+varsayilan heap'in ayari, olusturulan heap'ler her zaman mmap kullanir
+*/
 void heapster_set_mmap_threshold(size_t bytes) {
-    if (bytes < 4096) {
-        mmap_threshold = 4096;
-    } else {
-        mmap_threshold = bytes;
-    }
+    heap_set_mmap_threshold(&heap_default, bytes);
 }
 
 size_t heapster_get_mmap_threshold(void) {
-    return mmap_threshold;
+    return heap_default.mmap_threshold;
+}
+
+void heap_set_mmap_threshold(heapster_heap_t *heap, size_t bytes) {
+    heap->mmap_threshold = bytes < 4096 ? 4096 : bytes;
+}
+
+void arena_set_quick_limits(heapster_heap_t *heap, size_t max_size, size_t consolidate_threshold) {
+    heap->quick_max_size = max_size > QUICK_MAX_SIZE ? QUICK_MAX_SIZE : max_size;
+    heap->quick_consolidate_threshold = consolidate_threshold ? consolidate_threshold : 1;
+}
+
+void arena_set_purge_decay(heapster_heap_t *heap, unsigned decay_ms) {
+    heap->purge_decay_ms = decay_ms;
+}
+
+// sadece bundan sonra olusturulacak arenalari etkiler
+void heapster_set_huge_pages(heapster_huge_mode_t mode) {
+    huge_page_mode = mode;
+}
+
+heapster_huge_mode_t heapster_get_huge_pages(void) {
+    return huge_page_mode;
+}
+
+// sadece bundan sonra olusturulacak arenalari etkiler, var olanlar icin heapster_arena_set_deferred_coalescing
+void heapster_set_deferred_coalescing(int enabled) {
+    heap_default.deferred_coalesce_default = enabled ? 1 : 0;
+}
+
+int heapster_get_deferred_coalescing(void) {
+    return heap_default.deferred_coalesce_default;
+}
+
+// ptr'nin bulundugu arena icin ayari degistirir. kapatilirsa park halindeki blocklar hemen birlestirilir
+int heapster_arena_set_deferred_coalescing(void *ptr, int enabled) {
+    if (!ptr) {
+        return -1;
+    }
+
+    block_header_t *block = payload_to_block(ptr);
+    if (block_validate(block) <= 0) {
+        return -1;
+    }
+
+    epoch_enter();
+
+    arena_t *arena = arena_find_by_id(block->arena_id);
+    if (!arena) {
+        epoch_exit();
+        return -1;
+    }
+
+    arena_lock(arena);
+    arena->deferred_coalesce = enabled ? 1 : 0;
+    if (!arena->deferred_coalesce) {
+        arena_consolidate(arena);
+    }
+    arena_unlock(arena);
+
+    epoch_exit();
+    return 0;
+}
+
+// arena kilidini alir, beklemek zorunda kaldiysak bu kilit altinda arena statlarina yazilir
+void arena_lock(arena_t *arena) {
+    uint64_t waited = 0;
+    if (lock_acquire(&arena->lock, &waited)) {
+        arena->stats.lock_contended++;
+        arena->stats.lock_wait_ns += waited;
+    }
+}
+
+/*
+kilit birakilmadan once doluluk ipuclari ve fragmentation_ratio guncellenir. her kilitli bolge
+burada bittigi icin ayri ayri her alloc/free/drain yolunu takip etmeye gerek kalmiyor
+*/
+void arena_unlock(arena_t *arena) {
+    size_t free_bytes = arena->stats.free_bytes;
+    size_t largest = arena->free_tree_max ? arena->free_tree_max->size : arena->stats.largest_free_block;
+
+    arena->stats.fragmentation_ratio = free_bytes > 0 ? 1.0 - (double)largest / (double)free_bytes : 0.0;
+
+    atomic_store_explicit(&arena->free_hint, free_bytes, memory_order_relaxed);
+    atomic_store_explicit(&arena->largest_hint, largest, memory_order_relaxed);
+    atomic_store_explicit(&arena->frag_hint, (unsigned)(arena->stats.fragmentation_ratio * 1000.0), memory_order_relaxed);
+
+    lock_release(&arena->lock);
+}
+
+// kilitsiz, binde olarak arenanin dolu kismi (header'lar dahil)
+unsigned arena_occupancy_permille(arena_t *arena) {
+    size_t free_bytes = atomic_load_explicit(&arena->free_hint, memory_order_relaxed);
+    if (free_bytes >= arena->size) {
+        return 0;
+    }
+    return (unsigned)((arena->size - free_bytes) * 1000 / arena->size);
+}
+
+static pthread_key_t arena_owner_key;
+static pthread_once_t arena_owner_once = PTHREAD_ONCE_INIT;
+static _Thread_local int arena_owner_registered = 0;
+
+/*
+arena sahibi thread biterken. remote kuyrugu drain edecek sahip kalmaz ve baska threadlerin
+free'leri (kendi aldiklari blocklar dahil) hep kuyruga gider, arena bosalsa da yok edilmezdi.
+thread'in arenalari sahipsiz isaretlenir, bundan sonra onlara free kilitle yapilir. kuyrukta
+bekleyenler burada bosaltilir ve arena bosaldiysa yok edilir
+*/
+static void arena_owner_exit(void *value) {
+    (void)value;
+    pthread_t self = pthread_self();
+    heapster_heap_t *reclaim = NULL;
+
+    do {
+        reclaim = NULL;
+        epoch_enter();
+
+        for (heapster_heap_t *heap = heap_registry_first(); heap && !reclaim; heap = heap->next) {
+            for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+                // isaretlenmis arenalar tekrar gezildiginde atlanir
+                if (arena->is_shared || !pthread_equal(arena->owner, self) ||
+                    atomic_exchange(&arena->owner_exited, 1)) {
+                    continue;
+                }
+
+                arena_lock(arena);
+                int destroy = !arena->dead && arena_drain_remote_frees(arena);
+                arena_unlock(arena);
+
+                if (destroy) {
+                    arena_destroy(arena);
+                    reclaim = heap;
+                    break;
+                }
+            }
+        }
+
+        epoch_exit();
+
+        // listeden cikan arena okuma bolumu disinda geri verilir, gezinti bastan devam eder
+        if (reclaim) {
+            arena_collect_retired(reclaim);
+        }
+    } while (reclaim);
+
+    arena_owner_registered = 0;
+}
+
+static void arena_owner_key_init(void) {
+    pthread_key_create(&arena_owner_key, arena_owner_exit);
+}
+
+// arena sahibi olan thread'in cikisinda arena_owner_exit calissin diye key bir kez set edilir
+static void arena_owner_register(void) {
+    if (!arena_owner_registered) {
+        pthread_once(&arena_owner_once, arena_owner_key_init);
+        pthread_setspecific(arena_owner_key, (void *)1);
+        arena_owner_registered = 1;
+    }
+}
+
+// arena header'inin blocklardan bagimsiz alanlari, arena_init ve arena_adopt icin
+static arena_t *arena_init_header(heapster_heap_t *heap, void *addr, size_t size, int use_mmap) {
+    arena_t *arena = (arena_t *)addr;
+
+    arena->id = atomic_fetch_add(&arena_id_counter, 1);
+    arena->heap = heap;
+    lock_init(&arena->lock, lock_default_kind());
+
+    arena->start = (char *)addr;
+    arena->end   = (char *)addr + size;
+    arena->size  = size;
+
+    arena->free_list_head = NULL;
+    arena->next_fit_cursor = NULL;
+    free_tree_reset(arena);
+    arena->is_mmap = use_mmap;
+    arena->is_huge = 0;
+    arena->numa_node = -1;
+    arena->dead = 0;
+    arena->is_reserved = 0;
+    arena->is_shared = 0;
+    arena->last_purge_ns = 0;
+    arena->retire_epoch = 0;
+    arena->retired_next = NULL;
+
+    arena->deferred_coalesce = heap->deferred_coalesce_default;
+    memset(arena->quick_bins, 0, sizeof(arena->quick_bins));
+    arena->quick_count = 0;
+    arena->block_count = 0;
+
+    arena->owner = pthread_self();
+    atomic_init(&arena->owner_exited, 0);
+    atomic_init(&arena->remote_free_head, NULL);
+    atomic_init(&arena->remote_free_bytes, 0);
+    arena_owner_register();
+
+    arena_stats_reset(arena);
+    policy_adaptive_reset(arena);
+
+    return arena;
 }
 
 /* 
@@ -48,7 +243,7 @@ fieldlari pointerda adrese sirasiyla konur yani arena pointerina cevir-
 dikten sonra p->field dedigin an direk adresin basina koyar ve oyle devam
 eder. 
 */
-arena_t *arena_init(void *addr, size_t size, int use_mmap) {
+static arena_t *arena_init(heapster_heap_t *heap, void *addr, size_t size, int use_mmap) {
     uintptr_t raw      = (uintptr_t)addr + ARENA_HEADER_SIZE; 
     uintptr_t aligned  = (raw + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1); 
     
@@ -74,20 +269,7 @@ arena_t *arena_init(void *addr, size_t size, int use_mmap) {
         return NULL;  
     }
 
-    arena_t *arena = (arena_t *)addr;
-
-    arena->id = arena_id_counter;
-    pthread_mutex_init(&arena->lock, NULL);
-
-    arena->start = (char *)addr;
-    arena->end   = (char *)addr + size;
-    arena->size  = size;
-
-    arena->free_list_head = NULL;
-    arena->next_fit_cursor = NULL;
-    arena->is_mmap = use_mmap;
-
-    arena_stats_reset(arena);
+    arena_t *arena = arena_init_header(heap, addr, size, use_mmap);
 
     void *block_addr   = (void *)aligned;
     // ilk block headerinin baslayacagi adres
@@ -106,26 +288,157 @@ arena_t *arena_init(void *addr, size_t size, int use_mmap) {
         return NULL;
     }
 
-    first_block->arena_id = arena_id_counter++;
+    first_block->arena_id = arena->id;
 
     arena->free_list_head   = first_block;
     arena->next_fit_cursor  = first_block;
+    free_tree_insert(arena, first_block);
 
     arena->stats.total_bytes = size;
     arena->stats.free_bytes  = first_block->size;
     arena->stats.largest_free_block = first_block->size;
     arena->stats.free_block_count = 1;
     arena->stats.allocated_block_count = 0;
+
+    atomic_init(&arena->free_hint, first_block->size);
+    atomic_init(&arena->largest_hint, first_block->size);
+    atomic_init(&arena->frag_hint, 0);
     
     return arena;
 }
 
+/*
+huge page modunda buyuk arena icin mapping. size HUGE_PAGE_SIZE'in katina yuvarlanmis gelir.
+once (istenirse) MAP_HUGETLB denenir, hugetlbfs'te ayrilmis sayfa yoksa mmap hata verir ve
+THP yoluna dusulur: bir huge page fazlasi map edilir, bas ve sondaki fazlalik munmap ile
+kirpilir ki kalan aralik 2 MiB hizali olsun, sonra MADV_HUGEPAGE ile kernel'e oneri verilir.
+madvise desteklenmiyorsa (ya da THP kapaliysa) arena normal sayfalarla calismaya devam eder.
+*huge_kind'a arena->is_huge'a yazilacak deger doner
+*/
+static void *arena_map_huge(size_t size, int *huge_kind) {
+    *huge_kind = 0;
+
+#ifdef MAP_HUGETLB
+    if (huge_page_mode == HEAPSTER_HUGE_HUGETLB) {
+        void *addr = mmap(NULL, size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                          -1, 0);
+        if (addr != MAP_FAILED) {
+            *huge_kind = 2;
+            return addr;
+        }
+    }
+#endif
+
+    void *raw = mmap(NULL, size + HUGE_PAGE_SIZE,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (raw == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    uintptr_t start   = (uintptr_t)raw;
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    size_t head = aligned - start;
+    size_t tail = HUGE_PAGE_SIZE - head;
+
+    if (head) {
+        munmap(raw, head);
+    }
+    if (tail) {
+        munmap((void *)(aligned + size), tail);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (madvise((void *)aligned, size, MADV_HUGEPAGE) == 0) {
+        *huge_kind = 1;
+    }
+#endif
+
+    return (void *)aligned;
+}
+
+/*
+arenanin gercekten huge page ile desteklenen kismi. hugetlb arenasinin tamami oyle. THP'de
+madvise'in basarili olmasi bir sey demez (THP=never ya da defrag=never iken de 0 doner, purge
+sonrasi sayfalar da geri gider), kernel'in sayaci /proc/self/smaps'teki AnonHugePages okunur.
+smaps mapping (vma) basina sayar, komsu THP arenalari tek vma'da birlesmis olabilir: vma'nin
+arenaya dusen kismi kadar oranlanir. dosya okudugu icin sadece stats / dump yolunda, arena
+kilidi disinda cagrilir
+*/
+size_t arena_huge_backed_bytes(arena_t *arena) {
+    if (arena->is_huge == 2) {
+        return arena->size;
+    }
+    if (arena->is_huge != 1) {
+        return 0;
+    }
+
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        return 0;
+    }
+
+    uintptr_t start = (uintptr_t)arena->start;
+    uintptr_t end = (uintptr_t)arena->end;
+    size_t overlap = 0;
+    size_t vma_size = 0;
+    size_t backed = 0;
+    char line[256];
+
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long lo, hi, kb;
+
+        // vma basligi "lo-hi perms ...", alan satirlari "Isim:  N kB"
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+            uintptr_t from = lo > start ? lo : start;
+            uintptr_t to = hi < end ? hi : end;
+            overlap = to > from ? to - from : 0;
+            vma_size = hi - lo;
+            if (lo >= end) {
+                break;  // smaps adrese gore sirali
+            }
+        } else if (overlap && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            backed += (size_t)((double)kb * 1024.0 * (double)overlap / (double)vma_size);
+        }
+    }
+
+    fclose(smaps);
+    return backed;
+}
+
 /* 
 *   size =  (kullanicinin istedigi payload size i up align edilmis) + 
 *           (block_header_size up align edilmis)                    + 
 *           (arena_header_size up align edilmis)
 */
-arena_t *arena_create(size_t size) {
+arena_t *arena_create(heapster_heap_t *heap, size_t size) {
+    return arena_create_ex(heap, size, 0);
+}
+
+// header tamamen hazirlandiktan sonra yayinlanir, okuyucular yari kurulmus arena goremez
+void arena_publish(arena_t *arena) {
+    heapster_heap_t *heap = arena->heap;
+
+    pthread_mutex_lock(&heap->list_lock);
+    arena->next = atomic_load(&heap->arena_list_head);  
+    atomic_store(&heap->arena_list_head, arena);
+    pthread_mutex_unlock(&heap->list_lock);
+}
+
+/*
+flags (ARENA_CREATE_*): MMAP boyuttan bagimsiz mmap kullanir, POPULATE sayfalari mmap sirasinda
+doldurur (NUMA baglama ya da huge page gerekiyorsa yok sayilir, caller kendisi dokunmali),
+RESERVED arenayi hic yok edilmeyen/purge edilmeyen yapar, NO_PUBLISH listeye eklemez
+(caller hazirlayip arena_publish cagirir). varsayilan heap disindaki heap'lerin arenalari
+hep mmap'tir, sbrk arenasi heap'in ortasinda kalip destroy'da geri verilemeyebilirdi
+*/
+arena_t *arena_create_ex(heapster_heap_t *heap, size_t size, int flags) {
+
+    // fork sonrasi child'da kilitler takili kalmasin (fork.c)
+    fork_handlers_install();
 
     size_t page_size = sysconf(_SC_PAGE_SIZE);  
     size_t alloc_size = (size + page_size - 1) & ~(page_size - 1); // kernelden alinan miktar gercek yukari align edilcek page size a gore
@@ -134,17 +447,58 @@ arena_t *arena_create(size_t size) {
     arena_t *arena = NULL;
     // kullanici mmap den size ister ama mmap page aligned bir adres ve page size in kati olacak sekilde adres verir
     // ama bu verilen adres zaten oldugun sistemde alignof(max_align_t) bunun align istegini karsilar
-    if (size >= heapster_get_mmap_threshold()) {
-        addr = mmap(NULL, alloc_size,
-                    PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS,
-                    -1, 0);
+    // NUMA modunda mbind page aligned aralik istedigi icin kucuk arenalar da mmap ile alinir
+    int numa_node = numa_mode_enabled() ? numa_current_node() : -1;
+
+    if (!heap->is_default) {
+        flags |= ARENA_CREATE_MMAP;
+    }
+
+    if (size >= heap->mmap_threshold || numa_node >= 0 || (flags & ARENA_CREATE_MMAP)) {
+        int huge_kind = 0;
+        int populate = 0;
+#ifdef MAP_POPULATE
+        // NUMA'da sayfalar mbind'dan once dolarsa yanlis node'da kalir
+        if ((flags & ARENA_CREATE_POPULATE) && numa_node < 0) {
+            populate = MAP_POPULATE;
+        }
+#endif
+
+        int huge = huge_page_mode != HEAPSTER_HUGE_OFF && size >= HUGE_PAGE_SIZE;
+        if (huge) {
+            alloc_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        }
+
+        // hard_limit'i asacaksa syscall hic yapilmaz (budget.c)
+        if (budget_charge(heap, alloc_size, 1) != 0) {
+            return NULL;
+        }
+
+        if (huge) {
+            addr = arena_map_huge(alloc_size, &huge_kind);
+        } else {
+            addr = mmap(NULL, alloc_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | populate,
+                        -1, 0);
+        }
 
         // adresin basindan ilk olarak arena header gelcek sonra block heaeder gelcek sonra block payload ...
         if (addr == MAP_FAILED) {
+            budget_uncharge(heap, alloc_size);
             return NULL;
         }
-        arena = arena_init(addr, alloc_size, 1); // girilen adres page aligned bir adres ayni zamanda alignof(max_align_t) aligned
+
+        // arena_init header'a yazip ilk sayfaya dokunmadan once baglanmali
+        if (numa_node >= 0) {
+            numa_bind_range(addr, alloc_size, numa_node);
+        }
+
+        arena = arena_init(heap, addr, alloc_size, 1); // girilen adres page aligned bir adres ayni zamanda alignof(max_align_t) aligned
+        if (arena) {
+            arena->numa_node = numa_node;
+            arena->is_huge = huge_kind;
+        }
     } else {
 
     // kaba minimum (overhead burada hesaplanamaz cunku addr daha alınmadı)
@@ -153,12 +507,22 @@ arena_t *arena_create(size_t size) {
             size = min_size;
         }
 
+        // arena header cache line'lara hizali (alignas), break ona gore hizali degilse (baska biri sbrk
+        // kullandiysa) aradaki bosluk feda edilir, size da yukari yuvarlanir ki bir sonraki arena da hizali baslasin
+        size = (size + (HEAPSTER_CACHE_LINE - 1)) & ~((size_t)HEAPSTER_CACHE_LINE - 1);
+
+        if (budget_charge(heap, size, 1) != 0) {
+            return NULL;
+        }
+
         void *cur = sbrk(0);
-        if (sbrk(size) == (void *)-1) {
+        size_t pad = (HEAPSTER_CACHE_LINE - ((uintptr_t)cur & (HEAPSTER_CACHE_LINE - 1))) & (HEAPSTER_CACHE_LINE - 1);
+        if (sbrk(size + pad) == (void *)-1) {
+            budget_uncharge(heap, size);
             return NULL;
         }
-        addr = cur;
-        arena = arena_init(addr, size, 0);
+        addr = (char *)cur + pad;
+        arena = arena_init(heap, addr, size, 0);
     }
 
     if (!arena) {
@@ -166,28 +530,170 @@ arena_t *arena_create(size_t size) {
     } 
 
     arena->requested_size = size; // runtime icin anlami yok ama debug da ise yarar
-    
-    pthread_mutex_lock(&arena_list_lock);
-    arena->next = arena_list_head;  
-    arena_list_head = arena;
-    pthread_mutex_unlock(&arena_list_lock);
+    arena->is_reserved = (flags & ARENA_CREATE_RESERVED) ? 1 : 0;
+
+    if (!(flags & ARENA_CREATE_NO_PUBLISH)) {
+        arena_publish(arena);
+    }
 
     return arena;
 }
 
-// arena header haric tum data si 0 ile degisir (silinir) ve arena header sonrasi block header ekler tek buyuk block
-void arena_clear(arena_t *arena) {
+/*
+persist.c icin: caller'in map ettigi (dosyadan) addr'da bos bir arena kurar. arena hic yok
+edilmez ve purge edilmez (reserved), listeye eklenmez, caller hazir olunca arena_publish cagirir
+*/
+arena_t *arena_format(heapster_heap_t *heap, void *addr, size_t size) {
+    arena_t *arena = arena_init(heap, addr, size, 1);
     if (!arena) {
-        return;
+        return NULL;
     }
 
-    pthread_mutex_lock(&arena->lock);
+    // caller zaten map etti, limite takilmaz ama sayilir
+    budget_charge(heap, size, 0);
+
+    arena->requested_size = size;
+    arena->is_reserved = 1;
+    return arena;
+}
 
+/*
+persist.c icin: addr'da daha once (belki baska bir adreste, baska bir process'te) kurulmus bir
+arenanin blocklarini yeniden sahiplenir. header'daki pointer'larin hicbirine guvenilmez: arena
+header bastan kurulur, block zinciri sadece size'lardan yurunur, phys_prev/phys_next, free
+list, tree ve statlar yeniden olusturulur ve her blocka yeni arena id'si yazilir. quick
+bin'deki blocklar free sayilir, yan yana kalan free blocklar birlestirilir.
+
+once sadece okuyan bir tur atilir: block_validate'den gecmeyen, arenadan tasan ya da zinciri
+arenanin sonuna tam oturmayan bir block varsa hicbir seye yazilmadan NULL doner
+*/
+arena_t *arena_adopt(heapster_heap_t *heap, void *addr, size_t size) {
+    uintptr_t aligned = ((uintptr_t)addr + ARENA_HEADER_SIZE + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+    if (!addr || size < (aligned - (uintptr_t)addr) + BLOCK_MIN_SIZE) {
+        return NULL;
+    }
+
+    char *chain_start = (char *)aligned;
+    char *chain_end = chain_start + ((size - (aligned - (uintptr_t)addr)) & ~(ALIGNMENT - 1));
+
+    for (char *p = chain_start; p != chain_end; ) {
+        block_header_t *block = (block_header_t *)p;
+
+        if (p + BLOCK_HEADER_SIZE > chain_end) {
+            fprintf(stderr, "[heapster] adopt: block %p runs past the arena\n", (void *)block);
+            return NULL;
+        }
+
+        // quick bin'e park edilmis, deferred free ya da remote free kuyrugundaki blocklar
+        // validate'in -5'ine takilir ama saglamdir, hepsi asagida free sayilir
+        int rc = block_validate(block);
+        if (rc <= 0 && !(rc == -5 && (block->free == BLOCK_QUICK || block->free == BLOCK_DEFERRED ||
+                                      block->free == BLOCK_REMOTE))) {
+            fprintf(stderr, "[heapster] adopt: invalid block %p (%d)\n", (void *)block, rc);
+            return NULL;
+        }
+
+        if ((block->size & (ALIGNMENT - 1)) != 0 || block->size > (size_t)(chain_end - p) - BLOCK_HEADER_SIZE) {
+            fprintf(stderr, "[heapster] adopt: block %p has a bad size %zu\n", (void *)block, block->size);
+            return NULL;
+        }
+        if (block->free == 0 && block->requested_size > block->size) {
+            fprintf(stderr, "[heapster] adopt: block %p requested size %zu larger than the block\n",
+                    (void *)block, block->requested_size);
+            return NULL;
+        }
+
+        p += BLOCK_HEADER_SIZE + block->size;
+    }
+
+    arena_t *arena = arena_init_header(heap, addr, size, 1);
+    arena->requested_size = size;
+    arena->is_reserved = 1;
+    arena->stats.total_bytes = size;
+    budget_charge(heap, size, 0);
+
+    // 1. tur: phys zinciri, id'ler, birlestirme ve allocated statlari
+    block_header_t *prev = NULL;
+    for (char *p = chain_start; p != chain_end; ) {
+        block_header_t *block = (block_header_t *)p;
+        p += BLOCK_HEADER_SIZE + block->size;
+
+        if (block->free != 0) {
+            block->free = 1;
+            if (prev && prev->free == 1) {
+                prev->size += BLOCK_HEADER_SIZE + block->size;
+                continue;
+            }
+        }
+
+        block->arena_id = arena->id;
+        block->next = NULL;
+        block->prev = NULL;
+        block->phys_prev = prev;
+        block->phys_next = NULL;
+        if (prev) {
+            prev->phys_next = block;
+        }
+        arena->block_count++;
+
+        if (block->free == 0) {
+            arena->stats.used_bytes += block->size;
+            arena->stats.wasted_bytes += block->size - block->requested_size;
+            arena->stats.allocated_block_count++;
+
+            // checksum eski arena id'si ve (tasindiysa) eski adresle hesaplanmisti
+            if (block->check != 0) {
+                check_arm(block, check_armed_level(block));
+            }
+        }
+
+        prev = block;
+    }
+
+    // 2. tur: size'lar artik son halinde, free list adres sirali kurulur
+    block_header_t *tail = NULL;
+    for (block_header_t *block = (block_header_t *)chain_start; block; block = block->phys_next) {
+        if (block->free != 1) {
+            continue;
+        }
+
+        block->requested_size = 0;
+        block->check = 0;
+        block->prev = tail;
+        if (tail) {
+            tail->next = block;
+        } else {
+            arena->free_list_head = block;
+        }
+        tail = block;
+        free_tree_insert(arena, block);
+
+        arena->stats.free_bytes += block->size;
+        arena->stats.free_block_count++;
+        if (block->size > arena->stats.largest_free_block) {
+            arena->stats.largest_free_block = block->size;
+        }
+    }
+    arena->next_fit_cursor = arena->free_list_head;
+
+    // ipuclari ve fragmentation_ratio arena_unlock'ta hesaplanir
+    arena_lock(arena);
+    arena_unlock(arena);
+
+    return arena;
+}
+
+// arena header haric tum data si 0 ile degisir (silinir) ve arena header sonrasi block header ekler tek buyuk block
+// caller arena->lock'u tutmali
+static void arena_reset_locked(arena_t *arena) {
     void *clear_start = (char *)arena + ARENA_HEADER_SIZE;
     size_t clear_size = arena->size - ARENA_HEADER_SIZE;
 
     arena->free_list_head = NULL;
     arena->next_fit_cursor = NULL;
+    free_tree_reset(arena);
+    memset(arena->quick_bins, 0, sizeof(arena->quick_bins));
+    arena->quick_count = 0;
     arena_stats_reset(arena);
 
     memset(clear_start, 0, clear_size);
@@ -204,6 +710,7 @@ void arena_clear(arena_t *arena) {
         first_block->arena_id = arena->id;
         arena->free_list_head = first_block;
         arena->next_fit_cursor = first_block;
+        free_tree_insert(arena, first_block);
         arena->block_count = 1;
 
         arena->stats.total_bytes = arena->size;
@@ -213,64 +720,587 @@ void arena_clear(arena_t *arena) {
         arena->stats.allocated_block_count = 0; // Bu zaten reset ile 0'lanmış olabilir, ancak açıkça belirtmek güvenlidir.
 
     }
+}
 
-    pthread_mutex_unlock(&arena->lock);
+void arena_clear(arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+
+    arena_lock(arena);
+    arena_reset_locked(arena);
+    arena_unlock(arena);
 }
 
+// heap->list_lock tutulurken cagrilir. listeden cikarilir ama okuyucular hala arena->next'i okuyabilir, next degismez
+static void arena_unlink_locked(arena_t *arena) {
+    heapster_heap_t *heap = arena->heap;
+    arena_t *head = atomic_load(&heap->arena_list_head);
+
+    if (head == arena) {
+        atomic_store(&heap->arena_list_head, arena->next);
+    } else {
+        arena_t *prev = head;
+        while (prev && prev->next != arena) prev = prev->next;
+        if (prev) prev->next = arena->next;
+    }
+}
+
+// heap->list_lock tutulurken cagrilir. unlink sonrasi epoch ilerletilir, arena o epoch'tan once giren okuyucular cikinca geri verilir
+static void arena_retire_locked(arena_t *arena) {
+    heapster_heap_t *heap = arena->heap;
+
+    arena->retire_epoch = epoch_advance();
+    arena->retired_next = heap->retired_list_head;
+    heap->retired_list_head = arena;
+    atomic_store_explicit(&heap->retired_pending, 1, memory_order_relaxed);
+}
+
+/*
+heap->list_lock tutulurken cagrilir. artik hicbir okuyucunun goremeyecegi retired arenalar
+isletim sistemine geri verilir. mmap arenalari direk munmap edilir. sbrk arenasi ancak heap'in
+en ustundeyse kucultulebilir, o yuzden ustteki arenalar bitene kadar tekrar denenir.
+arada break baska bir yere kaydiysa sbrk arenasi geri verilemez: finalize sirasinda birakilir,
+normal calisirken sifirlanip listeye geri konur ki hafiza kaybolmasin
+*/
+static void arena_reclaim_locked(heapster_heap_t *heap, int finalizing) {
+    int progress = 1;
+
+    while (progress) {
+        progress = 0;
+
+        arena_t **link = &heap->retired_list_head;
+        while (*link) {
+            arena_t *arena = *link;
+
+            if (!epoch_is_safe(arena->retire_epoch)) {
+                link = &arena->retired_next;
+                continue;
+            }
+
+            if (arena->is_mmap) {
+                *link = arena->retired_next;
+                lock_destroy(&arena->lock);
+                budget_uncharge(heap, arena->size);
+                munmap(arena, arena->size);
+                progress = 1;
+                continue;
+            }
+
+            if ((uintptr_t)sbrk(0) == (uintptr_t)arena->end) {
+                *link = arena->retired_next;
+                lock_destroy(&arena->lock);
+                budget_uncharge(heap, arena->size);
+                sbrk(-arena->size);
+                progress = 1;
+                continue;
+            }
+
+            link = &arena->retired_next;
+        }
+    }
+
+    // kalanlar ya hala okunuyor ya da heap'in ortasinda kalmis sbrk arenalari
+    arena_t **link = &heap->retired_list_head;
+    while (*link) {
+        arena_t *arena = *link;
+
+        if (arena->is_mmap || !epoch_is_safe(arena->retire_epoch)) {
+            link = &arena->retired_next;
+            continue;
+        }
+
+        *link = arena->retired_next;
+        if (finalizing) {
+            continue;
+        }
+
+        arena_lock(arena);
+        arena->dead = 0;
+        arena_reset_locked(arena);
+        arena_unlock(arena);
+
+        arena->retired_next = NULL;
+        arena->next = atomic_load(&heap->arena_list_head);
+        atomic_store(&heap->arena_list_head, arena);
+    }
+
+    atomic_store_explicit(&heap->retired_pending, heap->retired_list_head != NULL, memory_order_relaxed);
+}
+
+// bekleyen retired arena varsa geri vermeyi dener. okuma bolumu disinda cagrilmali yoksa kendi epoch'umuz bloklar
+void arena_collect_retired(heapster_heap_t *heap) {
+    if (!atomic_load_explicit(&heap->retired_pending, memory_order_relaxed)) {
+        return;
+    }
+
+    pthread_mutex_lock(&heap->list_lock);
+    arena_reclaim_locked(heap, 0);
+    pthread_mutex_unlock(&heap->list_lock);
+}
+
+/*
+fork.c icin. heap->list_lock tutulurken cagrilir. listedeki ve retired listesindeki tum arena
+kilitleri alinir, retired arenalar da dahil cunku okuyucular onlari hala kilitleyebiliyor
+*/
+void arena_lock_all(heapster_heap_t *heap) {
+    for (arena_t *arena = atomic_load(&heap->arena_list_head); arena; arena = arena->next) {
+        arena_lock(arena);
+    }
+    for (arena_t *arena = heap->retired_list_head; arena; arena = arena->retired_next) {
+        arena_lock(arena);
+    }
+}
+
+void arena_unlock_all(heapster_heap_t *heap) {
+    for (arena_t *arena = heap->retired_list_head; arena; arena = arena->retired_next) {
+        arena_unlock(arena);
+    }
+    for (arena_t *arena = atomic_load(&heap->arena_list_head); arena; arena = arena->next) {
+        arena_unlock(arena);
+    }
+}
+
+// child'da: kilitler ayni turle bastan kurulur, tum arenalar hayatta kalan tek thread'in olur
+void arena_reinit_after_fork(heapster_heap_t *heap) {
+    pthread_t self = pthread_self();
+
+    for (arena_t *arena = atomic_load(&heap->arena_list_head); arena; arena = arena->next) {
+        lock_init(&arena->lock, arena->lock.kind);
+        arena->owner = self;
+        atomic_store(&arena->owner_exited, 0);
+    }
+    for (arena_t *arena = heap->retired_list_head; arena; arena = arena->retired_next) {
+        lock_init(&arena->lock, arena->lock.kind);
+        arena->owner = self;
+        atomic_store(&arena->owner_exited, 0);
+    }
+    arena_owner_register();
+}
+
+// arenada tek bir buyuk free block kaldiysa (tamamen bos) 1 doner
+static int arena_is_empty(arena_t *arena) {
+    block_header_t *head = arena->free_list_head;
+
+    return head &&
+           arena->block_count == 1 &&
+           !head->phys_prev &&
+           !head->phys_next &&
+           head->size + BLOCK_HEADER_SIZE == arena->size - ARENA_HEADER_SIZE;
+}
+
+/*
+bos arenayi yok eder. karar (arena_free_block'un 1 donmesi) arena kilidi disinda verildigi icin
+burada kilit altinda tekrar kontrol edilir: arada baska thread block almis ya da arenayi zaten
+yok etmis olabilir. listeden cikan arena dead isaretlenir, kilidi bekleyen thread onu gorunce
+bos doner. asil munmap/sbrk, okuyucular arenayi birakinca arena_reclaim_locked'da yapilir
+*/
 void arena_destroy(arena_t *arena) {
     if (!arena) return;
 
-    if (arena->is_mmap) {
-        pthread_mutex_lock(&arena_list_lock);
-        if (arena_list_head == arena) {
-            arena_list_head = arena->next;
+    heapster_heap_t *heap = arena->heap;
+
+    pthread_mutex_lock(&heap->list_lock);
+    arena_lock(arena);
+
+    // heapster_reserve ile alinan arenalar bos kalsa da tutulur
+    if (arena->dead || arena->is_reserved || !arena_is_empty(arena)) {
+        arena_unlock(arena);
+        pthread_mutex_unlock(&heap->list_lock);
+        return;
+    }
+
+    // heap'in ortasindaki sbrk arenasi geri verilemez sadece sifirlanir
+    if (!arena->is_mmap && (uintptr_t)sbrk(0) != (uintptr_t)arena->end) {
+        arena_reset_locked(arena);
+        arena_unlock(arena);
+        pthread_mutex_unlock(&heap->list_lock);
+        return;
+    }
+
+    arena->dead = 1;
+    arena_unlink_locked(arena);
+    arena_retire_locked(arena);
+    arena_unlock(arena);
+
+    arena_reclaim_locked(heap, 0);
+    pthread_mutex_unlock(&heap->list_lock);
+}
+
+// parametre olan size block icin olan payload size'i, caller arena->lock'u tutmali
+static block_header_t *arena_find_free_block(arena_t *arena, size_t block_payload_size) {
+    // baska threadlerin birakip gittigi blocklar once geri alinir, belki tam aradigimiz yer onlardir.
+    // arena bosalsa da yok edilmez, simdi ondan block alacagiz
+    arena_drain_remote_frees(arena);
+
+    // ayni boyutta park edilmis block varsa split/coalesce yok direk o verilir
+    if (arena->quick_count > 0 && block_payload_size <= arena->heap->quick_max_size) {
+        size_t idx = block_payload_size / ALIGNMENT - 1;
+        block_header_t *quick = arena->quick_bins[idx];
+        if (quick) {
+            arena->quick_bins[idx] = quick->next;
+            quick->next = NULL;
+            arena->quick_count--;
+            arena->stats.quick_hits++;
+            return quick;
+        }
+    }
+
+    block_header_t* b =  policy_find_block(arena, block_payload_size); 
+
+    // sigmadiysa park halindeki blocklari birlestirip bir kez daha dene
+    if (!b && arena->quick_count > 0) {
+        arena_consolidate(arena);
+        b = policy_find_block(arena, block_payload_size);
+    }
+
+    return b;
+}
+
+/*
+arenadan size byte'lik (payload'i aligned_payload_size) bir block ayirir, yer yoksa NULL.
+arama ve bolme ayni kilit altinda yapilir, eskiden arama kilidi birakip sonra tekrar aliyordu
+ve arada baska thread ayni blocku alabiliyordu. arena listeden cikarilmis (dead) ise
+kimse ona yeni block koymamali, NULL doner ve caller siradakine gecer
+*/
+void *arena_alloc(arena_t *arena, size_t aligned_payload_size, size_t size) {
+    if (!arena) return NULL;
+
+    arena_lock(arena);
+
+    if (arena->dead) {
+        arena_unlock(arena);
+        return NULL;
+    }
+
+    block_header_t *block = arena_find_free_block(arena, aligned_payload_size);
+    if (!block) {
+        arena_unlock(arena);
+        return NULL;
+    }
+
+    void *payload_ptr = NULL;
+    block_header_t *allocated_block = NULL;
+
+    size_t old_block_size = block->size; 
+    size_t old_largest_free = arena->stats.largest_free_block;
+    
+    arena_counter_add(arena, ARENA_COUNTER_MALLOC, 1);
+
+    if (block->size > aligned_payload_size + BLOCK_MIN_SIZE) {  // block_min_size split ten sonraki block icin yer varmi (block_split esitlikte split yapmaz)
+        // Split işlemi deneniyor
+        block_header_t *splitted_first_part = block_split(arena, block, aligned_payload_size);
+        
+        // Split başarıyla sonuçlandıysa
+        if (splitted_first_part) { 
+            allocated_block = splitted_first_part;
+            
+            // Tahsis edilen bloğu ayarla
+            allocated_block->requested_size = size;
+            allocated_block->check = 0;
+            payload_ptr = block_to_payload(allocated_block);
+            
+            // ** İSTATİSTİK GÜNCELLEME (SPLIT) **
+            size_t allocated_size = allocated_block->size;
+            
+            arena->stats.used_bytes += allocated_size; 
+            arena->stats.free_bytes -= allocated_size; 
+            
+            arena->stats.wasted_bytes += (allocated_size - size);
+            arena->stats.allocated_block_count++;
+            // free_block_count, block_split içinde zaten artırıldı.
+        } 
+
+    } else {
+        // Tam Kullanım Durumu (Split Yok)
+        
+        // Bloğu serbest listeden çıkar (Tamamen kullanıldığı için)
+        block_remove_from_free_list(arena, block);
+
+        // Bloğu tahsis edilmiş olarak işaretle
+        block->free = 0;
+        block->requested_size = size;    
+        block->magic = CTRL_CHR; 
+        block->check = 0;
+        payload_ptr = block_to_payload(block);
+        allocated_block = block; 
+        
+        // used_bytes / free_bytes: blockun payload'inin tamami
+        arena->stats.used_bytes += old_block_size; 
+        arena->stats.free_bytes -= old_block_size; 
+        
+        // wasted_bytes: istenen ile tahsis edilen arasindaki fark
+        arena->stats.wasted_bytes += (old_block_size - size);
+        
+        arena->stats.allocated_block_count++;
+        arena->stats.free_block_count--; // Serbest blok tamamen kullanıldığı için azalır.
+    }
+    
+    // Largest Free Block'u Yeniden Hesapla (Split/Tam kullanım sonrası)
+    // en buyuk block free tree'de hazir, liste sadece tree bos ise (hepsi tiny) taranir
+    if (old_largest_free == old_block_size) {
+        arena->stats.largest_free_block = 0;
+        if (arena->free_tree_max) {
+            arena->stats.largest_free_block = arena->free_tree_max->size;
         } else {
-            arena_t *prev = arena_list_head;
-            while (prev && prev->next != arena) prev = prev->next;
-            if (prev) prev->next = arena->next;
+            block_header_t *current = arena->free_list_head;
+            while (current) {
+                if (current->size > arena->stats.largest_free_block) {
+                    arena->stats.largest_free_block = current->size;
+                }
+                current = current->next;
+            }
+        }
+    }
+
+    arena_unlock(arena);
+    
+    return payload_ptr;
+}
+
+/*
+caller arena->lock'u tutmak zorunda. block free olarak isaretlenir, statlar guncellenir
+ve komsularla birlestirilir. donus degeri 1 ise arena tamamen bosaldi demektir ve caller
+kilidi biraktiktan sonra arena_destroy cagirabilir
+*/
+int arena_free_block(arena_t *arena, block_header_t *block) {
+    if (!arena || !block) {
+        return 0;
+    }
+
+    size_t freed_payload_size = block->size;
+
+    arena_counter_add(arena, ARENA_COUNTER_FREE, 1);
+    arena->stats.used_bytes -= freed_payload_size;
+    arena->stats.allocated_block_count--;
+
+    // Serbest kalan payload alanını free_bytes'a ekle
+    arena->stats.free_bytes += freed_payload_size;
+
+    // İç Fragmentasyon İadesi: Daha önce atanan israfı geri al
+    arena->stats.wasted_bytes -= (freed_payload_size - block->requested_size);
+
+    // Yeni bir serbest blok oluşacağı için sayacı artır (birleşme sonradan azaltacak)
+    arena->stats.free_block_count++;
+
+    block->requested_size = 0;
+
+    // deferred coalescing: kucuk block birlestirilmeden quick bin'e park edilir
+    if (arena->deferred_coalesce && block->size <= arena->heap->quick_max_size) {
+        size_t idx = block->size / ALIGNMENT - 1;
+
+        block->free = BLOCK_QUICK;
+        block->prev = NULL;
+        block->next = arena->quick_bins[idx];
+        arena->quick_bins[idx] = block;
+        arena->quick_count++;
+
+        // esik asildiysa ya da arenada kullanilan block kalmadiysa toplu birlestirme zamani
+        if (arena->quick_count >= arena->heap->quick_consolidate_threshold ||
+            arena->stats.allocated_block_count == 0) {
+            arena_consolidate(arena);
+        }
+
+        return arena_is_empty(arena);
+    }
+
+    block->free = 1;
+
+    block_header_t *coalesced_block = block_coalesce(arena, block);
+
+    // Birleşme sonrası en büyük serbest bloğu güncelle
+    if (coalesced_block && coalesced_block->size > arena->stats.largest_free_block) {
+        arena->stats.largest_free_block = coalesced_block->size;
+    }
+
+    // Tüm bellek tek bir serbest bloksa ve tahsis edilen bellek kalmadıysa
+    return arena_is_empty(arena);
+}
+
+/*
+caller arena->lock'u tutmak zorunda. free list'teki blocklarin tam sayfa olan ic kisimlari
+madvise(MADV_DONTNEED) ile kernel'e geri verilir, sanal adres kalir ve ilk dokunuşta sifir
+sayfa gelir. payload'in basindaki tree dugumu ve bir sonraki blockun header'i korunur.
+THP arenalarinda huge page'leri parcalamamak icin 2 MiB birimlerle yapilir, hugetlbfs
+arenalari purge edilmez (o sayfalar zaten rezerve havuzdan). donus degeri madvise edilen byte
+*/
+size_t arena_purge(arena_t *arena) {
+    if (!arena || arena->is_huge == 2) {
+        return 0;
+    }
+
+    size_t unit = arena->is_huge ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGE_SIZE);
+    size_t purged = 0;
+
+    for (block_header_t *b = arena->free_list_head; b; b = b->next) {
+        uintptr_t lo = (uintptr_t)block_to_payload(b) + FREE_TREE_MIN_SIZE;
+        uintptr_t hi = (uintptr_t)block_to_payload(b) + b->size;
+
+        lo = (lo + unit - 1) & ~(uintptr_t)(unit - 1);
+        hi &= ~(uintptr_t)(unit - 1);
+
+        if (hi > lo && madvise((void *)lo, hi - lo, MADV_DONTNEED) == 0) {
+            purged += hi - lo;
         }
-        pthread_mutex_unlock(&arena_list_lock);
+    }
+
+    arena->stats.purged_bytes += purged;
+    return purged;
+}
 
-        pthread_mutex_destroy(&arena->lock);
-        munmap(arena, arena->size);
+/*
+caller arena->lock'u tutmak zorunda. purge_decay_ms acikken free'den sonra cagrilir, arena
+en son purge'den beri decay suresi gectiyse purge edilir. ilk cagri sadece saati baslatir,
+yani bos kalan sayfalar en az bir decay suresi bekler
+*/
+void arena_maybe_purge(arena_t *arena) {
+    if (!arena || !arena->heap->purge_decay_ms || arena->is_reserved) {
         return;
     }
+    unsigned decay_ms = arena->heap->purge_decay_ms;
 
-    uintptr_t diff = (uintptr_t)sbrk(0) - (uintptr_t)arena->end;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 
-    if (diff == 0) {
-        pthread_mutex_lock(&arena_list_lock);
-        if (arena_list_head == arena) {
-            arena_list_head = arena->next;
-        } else {
-            arena_t *prev = arena_list_head;
-            while (prev && prev->next != arena) prev = prev->next;
-            if (prev) prev->next = arena->next;
+    if (arena->last_purge_ns == 0) {
+        arena->last_purge_ns = now;
+        return;
+    }
+
+    if (now - arena->last_purge_ns >= (uint64_t)decay_ms * 1000000ull) {
+        arena_purge(arena);
+        arena->last_purge_ns = now;
+    }
+}
+
+/*
+caller arena->lock'u tutmak zorunda. quick binlerdeki tum blocklar normal free blocka
+cevrilip komsulari ile birlestirilir. bir bin once tamamen listeden koparilir ki birlesme
+sirasinda henuz islenmemis quick blocklar (free == BLOCK_QUICK) yutulmasin, onlar sira
+kendilerine geldiginde birlesir. donus degeri birlestirilen block sayisi
+*/
+size_t arena_consolidate(arena_t *arena) {
+    if (!arena || arena->quick_count == 0) {
+        return 0;
+    }
+
+    size_t merged = 0;
+
+    for (size_t i = 0; i < QUICK_BIN_COUNT; i++) {
+        block_header_t *cur = arena->quick_bins[i];
+        arena->quick_bins[i] = NULL;
+
+        while (cur) {
+            block_header_t *next = cur->next;
+            cur->next = NULL;
+            cur->prev = NULL;
+            cur->free = 1;
+
+            block_header_t *coalesced = block_coalesce(arena, cur);
+            if (coalesced && coalesced->size > arena->stats.largest_free_block) {
+                arena->stats.largest_free_block = coalesced->size;
+            }
+
+            merged++;
+            cur = next;
         }
-        pthread_mutex_unlock(&arena_list_lock);
+    }
 
-        pthread_mutex_destroy(&arena->lock);
-        sbrk(-arena->size);
-    } else {
-        pthread_mutex_lock(&arena->lock);
-        arena_clear(arena); 
-        pthread_mutex_unlock(&arena->lock);
+    arena->quick_count = 0;
+    arena->stats.consolidations++;
+    return merged;
+}
+
+/*
+owner olmayan thread'in free'si: kilit yok, remote stack'e CAS ile push. block arena icin
+allocated kalir, gercek free islemi drain sirasinda yapilir. kuyrukta free == BLOCK_REMOTE:
+ikinci free block_validate'te reddedilir, ayni anda gelen iki free'den ikincisi de 0 ->
+BLOCK_REMOTE CAS'ini kaybeder ve -1 doner (block ikinci kez push edilmez).
+kuyruktakiler sayilirsa arena neredeyse bos kaldiysa (ARENA_DRAIN_PERMILLE alti) 1 doner,
+caller arena_reap_remote_frees cagirmali: malloc bu arenadan kacinir ve kuyrugu drain edecek
+kimse olmazdi
+*/
+int arena_remote_free(arena_t *arena, block_header_t *block) {
+    if (!arena || !block) {
+        return -1;
     }
+
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&block->free, &expected, BLOCK_REMOTE, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+
+    // push'tan sonra block drain edilip tekrar verilmis olabilir, boyut once okunur
+    size_t payload = block->size;
+
+    block_header_t *head = atomic_load_explicit(&arena->remote_free_head, memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&arena->remote_free_head, &head, block,
+                                                    memory_order_release, memory_order_relaxed));
+
+    size_t queued = atomic_fetch_add_explicit(&arena->remote_free_bytes, payload, memory_order_relaxed) + payload;
+    size_t free_bytes = atomic_load_explicit(&arena->free_hint, memory_order_relaxed) + queued;
+    size_t used = free_bytes < arena->size ? arena->size - free_bytes : 0;
+
+    return !arena->is_reserved && used * 1000 < (size_t)ARENA_DRAIN_PERMILLE * arena->size;
 }
 
-// parametre olan size block icin olan payload size'i
-block_header_t *arena_find_free_block(arena_t *arena, size_t block_payload_size) {
-    if (!arena || block_payload_size == 0) {
-        return NULL;
+/*
+caller arena->lock'u tutmak zorunda. remote stack tek exchange ile bosaltilir ve butun zincir
+tek seferde free edilir. arena burada destroy edilmez (kilit elimizde, caller listeyi geziyor
+olabilir): bir sey drain edildi ve arena tamamen bosaldiysa 1 doner, caller kilidi biraktiktan
+sonra arena_destroy cagirmali (arena_free_block ile ayni)
+*/
+int arena_drain_remote_frees(arena_t *arena) {
+    if (!arena || !atomic_load_explicit(&arena->remote_free_head, memory_order_relaxed)) {
+        return 0;
     }
 
-    pthread_mutex_lock(&arena->lock);
+    block_header_t *cur = atomic_exchange_explicit(&arena->remote_free_head, NULL, memory_order_acquire);
+    size_t drained = 0;
+    size_t drained_bytes = 0;
 
-    block_header_t* b =  policy_find_block(arena, block_payload_size); 
+    while (cur) {
+        block_header_t *next = cur->next;
+        cur->next = NULL;
+        cur->free = 0;
+        drained_bytes += cur->size;
+        arena_free_block(arena, cur);
+        drained++;
+        cur = next;
+    }
 
-    pthread_mutex_unlock(&arena->lock);
+    atomic_fetch_sub_explicit(&arena->remote_free_bytes, drained_bytes, memory_order_relaxed);
+    arena->stats.remote_free_calls += drained;
+    return drained > 0 && arena_is_empty(arena);
+}
 
-    return b;
+/*
+malloc'un atladigi neredeyse bos arenalar icin. oraya free'ler cogunlukla baska threadlerden
+gelir ve kuyrukta kalir, sadece arena_alloc drain ederdi (malloc o arenadan kacindigi icin
+neredeyse hic). kuyruk doluysa ve kilit bostaysa burada drain edilir, arena bosaldiysa yok
+edilir, bosalmadiysa free sayfalari purge edilebilir. kilit doluysa beklenmez. caller okuma
+bolumu icinde, 1 = arena yok edildi
+*/
+int arena_reap_remote_frees(arena_t *arena) {
+    if (!atomic_load_explicit(&arena->remote_free_head, memory_order_relaxed) ||
+        !lock_try_acquire(&arena->lock)) {
+        return 0;
+    }
+
+    int destroy = !arena->dead && arena_drain_remote_frees(arena);
+    if (!destroy && !arena->dead) {
+        arena_maybe_purge(arena);
+    }
+    arena_unlock(arena);
+
+    if (destroy) {
+        arena_destroy(arena);
+    }
+    return destroy;
 }
 
 void arena_dump(arena_t *arena) {
@@ -279,8 +1309,11 @@ void arena_dump(arena_t *arena) {
         return;
     }
 
+    // smaps okunurken kilit tutulmasin
+    size_t huge_bytes = arena_huge_backed_bytes(arena);
+
     // Kilit yönetimini ekleyin
-    pthread_mutex_lock(&arena->lock); 
+    arena_lock(arena); 
 
     printf("===== arena %llu =====\n", (unsigned long long)arena->id);
     printf("start addr        : %p\n", arena->start);
@@ -292,10 +1325,7 @@ void arena_dump(arena_t *arena) {
     // *********************************************************
     // İSTATİSTİK RAPORLAMA VE FRAGMENTASYON HESAPLAMASI (EKLENDİ)
     // *********************************************************
-    double fragmentation_ratio = 0.0;
-    if (arena->stats.free_bytes > 0) {
-        fragmentation_ratio = 1.0 - ((double)arena->stats.largest_free_block / arena->stats.free_bytes);
-    }
+    double fragmentation_ratio = arena->stats.fragmentation_ratio;  // arena_unlock'ta guncelleniyor
 
     printf("\n--- stats ---\n");
     printf("total bytes    : %zu\n", arena->stats.total_bytes);
@@ -305,56 +1335,175 @@ void arena_dump(arena_t *arena) {
     printf("free blocks    : %zu\n", arena->stats.free_block_count);
     printf("largest free blk: %zu\n", arena->stats.largest_free_block);
     printf("wasted (internal) : %zu\n", arena->stats.wasted_bytes);
+    printf("numa node      : %d\n", arena->numa_node);
+    printf("reserved       : %s\n", arena->is_reserved ? "yes" : "no");
+    printf("occupancy      : %.1f%%%s\n", arena_occupancy_permille(arena) / 10.0,
+           arena_occupancy_permille(arena) < ARENA_DRAIN_PERMILLE && !arena->is_reserved ? " (draining)" : "");
+    printf("huge page bytes: %zu (%s)\n", huge_bytes,
+           arena->is_huge == 2 ? "hugetlb" : arena->is_huge == 1 ? "thp" : "none");
     printf("fragmentation ratio: %.4f\n", fragmentation_ratio);
     
-    printf("malloc calls   : %llu\n", (unsigned long long)arena->stats.malloc_calls);
-    printf("free calls     : %llu\n", (unsigned long long)arena->stats.free_calls);
-    printf("realloc calls  : %llu\n", (unsigned long long)arena->stats.realloc_calls);
-    printf("calloc calls   : %llu\n", (unsigned long long)arena->stats.calloc_calls);
+    printf("malloc calls   : %llu\n", (unsigned long long)arena_counter_sum(arena, ARENA_COUNTER_MALLOC));
+    printf("free calls     : %llu\n", (unsigned long long)arena_counter_sum(arena, ARENA_COUNTER_FREE));
+    printf("realloc calls  : %llu\n", (unsigned long long)arena_counter_sum(arena, ARENA_COUNTER_REALLOC));
+    printf("calloc calls   : %llu\n", (unsigned long long)arena_counter_sum(arena, ARENA_COUNTER_CALLOC));
+    printf("remote frees   : %llu\n", (unsigned long long)arena->stats.remote_free_calls);
+    printf("deferred coalesce: %s (%zu parked, %llu quick hits, %llu consolidations)\n",
+           arena->deferred_coalesce ? "on" : "off", arena->quick_count,
+           (unsigned long long)arena->stats.quick_hits,
+           (unsigned long long)arena->stats.consolidations);
+    printf("purged bytes   : %zu\n", arena->stats.purged_bytes);
+    printf("lock           : %s (%llu contended, %llu ns waited)\n",
+           arena->lock.kind == HEAPSTER_LOCK_TICKET ? "ticket" :
+           arena->lock.kind == HEAPSTER_LOCK_ADAPTIVE ? "adaptive" : "mutex",
+           (unsigned long long)arena->stats.lock_contended,
+           (unsigned long long)arena->stats.lock_wait_ns);
+
+    heapster_policy_t policy = heap_get_policy(arena->heap);
+    double avg_steps = arena->stats.policy_searches
+                     ? (double)arena->stats.policy_search_steps / arena->stats.policy_searches : 0.0;
+    if (policy == HEAPSTER_ADAPTIVE) {
+        printf("policy         : adaptive -> %s (%llu switches, %.1f steps/search)\n",
+               policy_name(arena->adaptive.current),
+               (unsigned long long)arena->stats.policy_switches, avg_steps);
+        printf("adaptive cost  :");
+        for (int p = 0; p < POLICY_CONCRETE_COUNT; p++) {
+            if (arena->adaptive.cost[p] < 0.0) {
+                printf(" %s -", policy_name(p));
+            } else {
+                printf(" %s %.2f", policy_name(p), arena->adaptive.cost[p]);
+            }
+        }
+        printf("\n");
+    } else {
+        printf("policy         : %s (%.1f steps/search)\n", policy_name(policy), avg_steps);
+    }
     
     // Blok serbest listesini dök
     block_dump_free_list(arena);
 
     // Kilit yönetimini ekleyin
-    pthread_mutex_unlock(&arena->lock); 
+    arena_unlock(arena); 
 
     printf("====================\n\n");
 }
 
-arena_t *arena_get_list(void) {
-    return arena_list_head;
+// caller epoch_enter / epoch_exit arasinda olmali
+arena_t *arena_get_list(heapster_heap_t *heap) {
+    return atomic_load_explicit(&heap->arena_list_head, memory_order_acquire);
 }
 
-int last_cleanup(void) {
-    arena_t *cur = arena_list_head;
-    while (cur) {
-        arena_t *next = cur->next;
-        arena_destroy(cur);
-        cur = next;
+/*
+block->arena_id'den arenayi bulur, yoksa NULL. pointer herhangi bir heap'ten gelmis olabilir,
+once varsayilan heap sonra diger heap'ler gezilir. caller epoch_enter / epoch_exit arasinda olmali
+*/
+arena_t *arena_find_by_id(uint64_t id) {
+    for (heapster_heap_t *heap = heap_registry_first(); heap; heap = heap->next) {
+        for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+            if (arena->id == id) {
+                return arena;
+            }
+        }
     }
 
-    arena_list_head = NULL; // tüm arenalar yok edildi
-    return 0;
+    // shared memory heap'leri registry'de degil
+    return shm_find_arena(id);
 }
 
-void heapster_status(void) {
+/*
+heap'in tum arenalari bosluklarina bakilmadan listeden cikarilir, once girmis tum okuyucularin
+cikmasi beklenir ve hepsi geri verilir. finalize ve heapster_heap_destroy icin, okuma bolumu
+icinden cagrilmamali
+*/
+void arena_release_all(heapster_heap_t *heap) {
+    pthread_mutex_lock(&heap->list_lock);
 
-    printf("arena stats explanation: \n");
+    arena_t *cur = atomic_exchange(&heap->arena_list_head, NULL);
+    while (cur) {
+        arena_t *next = cur->next;
+
+        arena_lock(cur);
+        cur->dead = 1;
+        arena_unlock(cur);
+
+        arena_retire_locked(cur);
+        cur = next;
+    }
 
-    pthread_mutex_lock(&arena_list_lock); 
+    epoch_synchronize(epoch_advance());
+    arena_reclaim_locked(heap, 1);
+
+    pthread_mutex_unlock(&heap->list_lock);
+}
 
-    if (!arena_list_head) {
-        fprintf(stderr, "[fatal error] arena list head is NULL\n"); 
-        pthread_mutex_unlock(&arena_list_lock); 
+// tek bir heap'in arenalari ve toplamlari. caller okuma bolumunde olmali
+void heap_dump(heapster_heap_t *heap) {
+    arena_t *head = arena_get_list(heap);
+    if (!head) {
+        if (heap->is_default) {
+            fprintf(stderr, "[fatal error] arena list head is NULL\n"); 
+        } else if (heap->name[0]) {
+            printf("===== heap %p (%s) has no arenas =====\n\n", (void *)heap, heap->name);
+        } else {
+            printf("===== heap %p has no arenas =====\n\n", (void *)heap);
+        }
         return;
-    } 
+    }
 
-    arena_t *head = arena_list_head;
     while (head) {
         arena_dump(head);
-        // arena_stats_print(head); // BU SATIRI KALDIRIN
         head = head->next;
     }
 
-    pthread_mutex_unlock(&arena_list_lock); 
-}
\ No newline at end of file
+    heapster_stats_t total;
+    heapster_stats_update_global(heap, &total);
+
+    if (heap->is_default) {
+        printf("===== all arenas =====\n");
+    } else if (heap->name[0]) {
+        printf("===== all arenas of heap %p (%s) =====\n", (void *)heap, heap->name);
+    } else {
+        printf("===== all arenas of heap %p =====\n", (void *)heap);
+    }
+    printf("total bytes    : %zu\n", total.total_bytes);
+    printf("used bytes     : %zu\n", total.used_bytes);
+    printf("free bytes     : %zu\n", total.free_bytes);
+    printf("huge page bytes: %zu\n", total.huge_bytes);
+    printf("fragmentation ratio: %.4f\n", total.fragmentation_ratio);
+    printf("lock contended : %llu (%llu ns waited)\n",
+           (unsigned long long)total.lock_contended, (unsigned long long)total.lock_wait_ns);
+    printf("policy searches: %llu (%.1f steps/search, %llu adaptive switches, %llu free list steps)\n",
+           (unsigned long long)total.policy_searches,
+           total.policy_searches ? (double)total.policy_search_steps / total.policy_searches : 0.0,
+           (unsigned long long)total.policy_switches,
+           (unsigned long long)total.free_list_steps);
+    if (heap->is_default) {
+        printf("thread cache   : %zu blocks (this thread, %u per size class)\n",
+               tcache_cached_blocks(), heapster_get_tcache_count());
+        deferred_dump();
+    }
+    budget_dump(heap);
+    if (heap->is_default && (heapster_get_check_level() != HEAPSTER_CHECK_OFF || check_error_count() != 0)) {
+        printf("integrity errors: %llu (check level %d, 1 in %u sampled)\n",
+               (unsigned long long)check_error_count(), (int)heapster_get_check_level(),
+               heapster_get_check_sample_rate());
+    }
+    printf("====================\n\n");
+}
+
+void heapster_status(void) {
+
+    printf("arena stats explanation: \n");
+
+    epoch_enter();
+
+    for (heapster_heap_t *heap = heap_registry_first(); heap; heap = heap->next) {
+        heap_dump(heap);
+    }
+
+    shm_dump();
+
+    epoch_exit();
+
+    rt_dump();
+}
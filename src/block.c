@@ -5,19 +5,14 @@
 #include <stdbool.h>
 
 // freeden kast edilen user malloc calloc realloc ile almamis halde duran block
+// listeye girmemis free block'un prev'i her zaman NULL'dur (init, split, remove hepsi NULL'lar)
+// o yuzden listeyi gezmeye gerek yok, O(1)
 static inline bool block_is_in_free_list(arena_t *arena, block_header_t *b) {
     if (!arena || !b || b->free != 1) {
         return false;
     }
 
-    block_header_t *curr = arena->free_list_head;
-    while (curr) {
-        if (curr == b) {
-            return true;
-        }
-        curr = curr->next;
-    }
-    return false;
+    return b->prev != NULL || arena->free_list_head == b;
 }
 
 /*
@@ -77,10 +72,13 @@ void block_add_to_free_list(arena_t *arena, block_header_t *block) {
     block_header_t *current = arena->free_list_head;
     block_header_t *prev = NULL;
 
+    uint64_t walked = 0;
     while (current && current < block) {
         prev = current;
         current = current->next;
+        walked++;
     }
+    arena->stats.free_list_steps += walked;
 
     block->next = current;
     block->prev = prev;
@@ -99,6 +97,7 @@ void block_add_to_free_list(arena_t *arena, block_header_t *block) {
         block->arena_id = arena->id;
     }
 
+    free_tree_insert(arena, block);
 }
 
 /* remove a block from the free list */
@@ -111,6 +110,8 @@ void block_remove_from_free_list(arena_t *arena, block_header_t *block) {
         return;
     }
 
+    free_tree_remove(arena, block);
+
     if (block->prev) {
         block->prev->next = block->next;
     } else {
@@ -188,19 +189,23 @@ block_header_t *block_split(arena_t *arena, block_header_t *block, size_t size)
     return block; // not: caller genelde allocate edilen 'block' ile ilgilenir
 }
 
-/* coalesce: merge with left and then as many rights as possible; returns leftmost merged free block */
 /* coalesce: merge with left and then as many rights as possible; returns leftmost merged free block */
 block_header_t *block_coalesce(arena_t *arena, block_header_t *block) {
     if (!arena || !block || block->free != 1) {
         return NULL;
     }
 
+    // tree size'a gore sirali, size degisecegi icin block once listeden (ve tree'den) cikar
+    if (block_is_in_free_list(arena, block)) {
+        block_remove_from_free_list(arena, block);
+    }
+
     // 1. ÖNCEKİ BLOK İLE BİRLEŞTİRME (LEFT COALESCING)
     if (block->phys_prev && block->phys_prev->free == 1) {
         block_header_t *prev = block->phys_prev;
 
-        if (block_is_in_free_list(arena, block)) {
-            block_remove_from_free_list(arena, block);
+        if (block_is_in_free_list(arena, prev)) {
+            block_remove_from_free_list(arena, prev);
         }
 
         prev->size += BLOCK_HEADER_SIZE + block->size;
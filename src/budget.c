@@ -0,0 +1,189 @@
+// budget.c
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+heap isletim sistemi reddedene kadar sbrk / mmap yapiyordu, container'da bu cache'i birakmak
+yerine OOM kill demek. burada heap basina bir bellek butcesi var:
+
+- heap->mapped_bytes heap'in arenalarinin toplam boyutu (stats.total_bytes'larin toplami).
+  sadece arena alinirken (arena_create_ex, syscall'dan once) ve isletim sistemine geri
+  verilirken (arena_reclaim_locked) degisir, malloc / free yolunda hicbir maliyeti yok
+- hard_limit: yeni arena toplami bu siniri gececekse arena_create_ex syscall yapmadan NULL
+  doner, malloc mevcut arenalarda yer bulamazsa NULL. CAS ile ayrildigi icin ayni anda buyuyen
+  threadler birlikte siniri asamaz
+- soft_limit: toplam bu siniri yukari dogru gectiginde heap'e pressure isaretlenir. arenayi
+  alan malloc okuma bolumunden cikinca (kilit ve epoch tutmadan) kayitli callback'i cagirir ve
+  heapster_heap_trim ile bos arenalari geri verir, kalan free sayfalari purge eder. toplam
+  soft_limit'in altina inip tekrar gecince yine tetiklenir. hard_limit'e ilk takilan malloc
+  callback'i HARD seviyesiyle cagirir (trim yok, o yol syscall'siz kalir), heap'ten bir arena
+  geri verilene kadar tekrar cagrilmaz
+- dosya, shared ve handle heap'lerinin arenalari caller'in map ettigi yerde kurulur, sayilir
+  ama limite takilmaz (zaten buyumezler)
+*/
+
+void heapster_heap_set_limits(heapster_heap_t *heap, size_t soft_limit, size_t hard_limit) {
+    heap = heap ? heap : &heap_default;
+
+    if (hard_limit != 0 && soft_limit > hard_limit) {
+        soft_limit = hard_limit;
+    }
+    atomic_store(&heap->soft_limit, soft_limit);
+    atomic_store(&heap->hard_limit, hard_limit);
+}
+
+void heapster_heap_get_limits(heapster_heap_t *heap, size_t *soft_limit, size_t *hard_limit) {
+    heap = heap ? heap : &heap_default;
+
+    if (soft_limit) {
+        *soft_limit = atomic_load(&heap->soft_limit);
+    }
+    if (hard_limit) {
+        *hard_limit = atomic_load(&heap->hard_limit);
+    }
+}
+
+size_t heapster_heap_mapped_bytes(heapster_heap_t *heap) {
+    heap = heap ? heap : &heap_default;
+    return atomic_load(&heap->mapped_bytes);
+}
+
+void heapster_heap_set_pressure_callback(heapster_heap_t *heap, heapster_pressure_fn fn, void *arg) {
+    heap = heap ? heap : &heap_default;
+
+    pthread_mutex_lock(&heap->list_lock);
+    heap->pressure_fn = fn;
+    heap->pressure_arg = arg;
+    pthread_mutex_unlock(&heap->list_lock);
+}
+
+/*
+arena_create_ex'ten, mmap / sbrk'ten once. enforce 0 ise (caller'in map ettigi arenalar) sadece
+sayilir. 0 = alinabilir, -1 = hard_limit asilirdi, syscall yapilmamali
+*/
+int budget_charge(heapster_heap_t *heap, size_t bytes, int enforce) {
+    size_t hard = atomic_load_explicit(&heap->hard_limit, memory_order_relaxed);
+    size_t cur = atomic_load_explicit(&heap->mapped_bytes, memory_order_relaxed);
+    size_t next;
+
+    do {
+        next = cur + bytes;
+        if (enforce && hard != 0 && (next > hard || next < cur)) {
+            atomic_fetch_add_explicit(&heap->budget_hard_failures, 1, memory_order_relaxed);
+            // duvara her carpista degil, bir kez. heap'ten bir sey geri verilince tekrar kurulur
+            if (!atomic_exchange_explicit(&heap->hard_latched, 1, memory_order_relaxed)) {
+                atomic_store_explicit(&heap->pressure_pending, HEAPSTER_PRESSURE_HARD, memory_order_relaxed);
+            }
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&heap->mapped_bytes, &cur, next,
+                                                    memory_order_relaxed, memory_order_relaxed));
+
+    size_t soft = atomic_load_explicit(&heap->soft_limit, memory_order_relaxed);
+    if (soft != 0 && cur <= soft && next > soft) {
+        int expected = 0;
+        atomic_compare_exchange_strong(&heap->pressure_pending, &expected, HEAPSTER_PRESSURE_SOFT);
+    }
+    return 0;
+}
+
+// arena isletim sistemine geri verildi (ya da syscall basarisiz oldu)
+void budget_uncharge(heapster_heap_t *heap, size_t bytes) {
+    atomic_fetch_sub_explicit(&heap->mapped_bytes, bytes, memory_order_relaxed);
+    atomic_store_explicit(&heap->hard_latched, 0, memory_order_relaxed);
+}
+
+/*
+heap_malloc'tan, yeni arena denendiyse ve okuma bolumunden cikildiktan sonra. callback burada
+heapster_free, heapster_heap_trim ya da baska heap'lerden malloc cagirabilir
+*/
+void budget_handle_pressure(heapster_heap_t *heap) {
+    if (__builtin_expect(!atomic_load_explicit(&heap->pressure_pending, memory_order_relaxed), 1)) {
+        return;
+    }
+
+    int level = atomic_exchange(&heap->pressure_pending, 0);
+    if (!level) {
+        return;  // baska bir thread aldi
+    }
+    atomic_fetch_add_explicit(&heap->budget_pressure_events, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&heap->list_lock);
+    heapster_pressure_fn fn = heap->pressure_fn;
+    void *arg = heap->pressure_arg;
+    pthread_mutex_unlock(&heap->list_lock);
+
+    size_t limit = level == HEAPSTER_PRESSURE_HARD ? atomic_load(&heap->hard_limit) : atomic_load(&heap->soft_limit);
+    if (fn) {
+        fn(heap, level, atomic_load(&heap->mapped_bytes), limit, arg);
+    }
+
+    // callback'in birakip bosalttigi arenalar da ayni turda gider. hard limitte malloc zaten
+    // NULL dondu, trim'in madvise / munmap'i o yola eklenmez
+    if (level == HEAPSTER_PRESSURE_SOFT) {
+        heapster_heap_trim(heap);
+    }
+}
+
+/*
+heap'in tum arenalarinda: remote free'ler ve quick bin'ler bosaltilir, tamamen bos kalan arena
+yok edilir (reserved olanlar haric), digerlerinin free sayfalari purge edilir. donus degeri
+isletim sistemine geri verilen (unmap + purge) byte. okuma bolumu icinden cagrilmamali
+*/
+size_t heapster_heap_trim(heapster_heap_t *heap) {
+    heap = heap ? heap : &heap_default;
+
+    size_t mapped_before = atomic_load(&heap->mapped_bytes);
+    size_t purged = 0;
+
+    epoch_enter();
+
+    arena_t *arena = arena_get_list(heap);
+    while (arena) {
+        arena_t *next = arena->next;
+
+        arena_lock(arena);
+        if (arena->dead) {
+            arena_unlock(arena);
+            arena = next;
+            continue;
+        }
+        arena_drain_remote_frees(arena);
+        if (arena->quick_count > 0) {
+            arena_consolidate(arena);
+        }
+        if (!arena->is_reserved) {
+            purged += arena_purge(arena);
+        }
+        arena_unlock(arena);
+
+        // bos degilse ya da reserved ise hicbir sey yapmaz
+        if (!arena->is_reserved) {
+            arena_destroy(arena);
+        }
+        arena = next;
+    }
+
+    epoch_exit();
+    arena_collect_retired(heap);
+
+    size_t mapped_after = atomic_load(&heap->mapped_bytes);
+    return purged + (mapped_before > mapped_after ? mapped_before - mapped_after : 0);
+}
+
+// heap_dump'tan, limit ya da olay yoksa yazilmaz
+void budget_dump(heapster_heap_t *heap) {
+    size_t soft = atomic_load(&heap->soft_limit);
+    size_t hard = atomic_load(&heap->hard_limit);
+    uint64_t events = atomic_load(&heap->budget_pressure_events);
+    uint64_t failures = atomic_load(&heap->budget_hard_failures);
+
+    if (!soft && !hard && !events && !failures) {
+        return;
+    }
+    printf("memory budget  : %zu mapped (soft %zu, hard %zu), %llu pressure events, %llu hard limit failures\n",
+           atomic_load(&heap->mapped_bytes), soft, hard,
+           (unsigned long long)events, (unsigned long long)failures);
+}
@@ -0,0 +1,260 @@
+// check.c
+#include <string.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+block_validate sadece magic'e bakiyordu. magic free'den sonra da yerinde kaldigi icin double
+free yakalanmiyordu, payload'in sonundan tasan yazma da bir sonraki header'i bozana kadar
+(ve bozduktan sonra da) gorunmuyordu. burada maliyeti ayarlanabilen bir kontrol katmani var:
+
+- HEADERS: allocation'da header'in (adres, size, requested_size, arena_id, magic) checksum'i
+  block->check'e yazilir, free/realloc'ta tekrar hesaplanir. ayrica free edilen blockun
+  free flag'i zaten 1 (ya da quick) ise double free raporlanir
+- CANARIES: ustune payload + requested_size'a 8 byte canary yazilir (requested_size ve
+  adresten turetilir), free'de degismisse buffer overrun raporlanir. yer acmak icin
+  canary'li allocation'lar 8 byte buyuk ayrilir
+
+bozuk bulunan block free edilmez (leak edilir), bozuk bir header'i free list'e sokmak
+sonraki allocation'lari da bozardi. sample_rate ile her thread N allocation'da birini arm
+eder, production'da makinelerin bir kisminda acik birakilabilsin diye. kapaliyken
+malloc/free'de tek bir global okuma ve branch var (arm edilmemis blockta check = 0).
+
+heapster_check_heap tum heap'lerin arenalarini kilitleyip phys_next zincirini bastan sona
+gezer ve zincirin, free list'in ve arm edilmis blocklarin tutarliligina bakar.
+*/
+
+_Atomic int check_level = HEAPSTER_CHECK_OFF;
+static _Atomic unsigned check_sample_rate = 1;
+static _Atomic uint64_t check_errors = 0;
+
+// bu thread'de arm edilmeden gecilecek allocation sayisi
+static _Thread_local unsigned check_countdown = 0;
+
+#define CHECK_CANARY_SEED 0x5A17C0FFEEULL
+
+static inline uint64_t check_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// phys_prev/phys_next komsular birlesince degisir, checksum'a girmez
+static uint32_t check_header_sum(const block_header_t *block) {
+    uint64_t h = (uint64_t)(uintptr_t)block;
+    h ^= check_mix((uint64_t)block->size + CHECK_CANARY_SEED);
+    h ^= check_mix((uint64_t)block->requested_size);
+    h ^= ((uint64_t)(uint32_t)block->arena_id << 32) | block->magic;
+
+    uint32_t sum = (uint32_t)check_mix(h) & ~CHECK_CANARY_BIT;
+    return sum ? sum : 1;
+}
+
+static uint64_t check_canary_value(const block_header_t *block) {
+    return check_mix((uint64_t)(uintptr_t)block ^ block->requested_size ^ CHECK_CANARY_SEED);
+}
+
+static void check_report(const char *op, const void *ptr, const char *what) {
+    atomic_fetch_add_explicit(&check_errors, 1, memory_order_relaxed);
+    fprintf(stderr, "[heapster] %s: %s %p\n", op, what, ptr);
+}
+
+void heapster_set_check_level(heapster_check_level_t level, unsigned sample_rate) {
+    if (level < HEAPSTER_CHECK_OFF || level > HEAPSTER_CHECK_CANARIES) {
+        level = HEAPSTER_CHECK_OFF;
+    }
+    atomic_store(&check_sample_rate, sample_rate ? sample_rate : 1);
+    atomic_store(&check_level, level);
+}
+
+heapster_check_level_t heapster_get_check_level(void) {
+    return (heapster_check_level_t)atomic_load(&check_level);
+}
+
+unsigned heapster_get_check_sample_rate(void) {
+    return atomic_load(&check_sample_rate);
+}
+
+uint64_t check_error_count(void) {
+    return atomic_load_explicit(&check_errors, memory_order_relaxed);
+}
+
+// siradaki allocation ne kadar kontrol edilecek (0 = hic). caller check_level'in acik oldugunu gordu
+int check_sample(void) {
+    unsigned rate = atomic_load_explicit(&check_sample_rate, memory_order_relaxed);
+    if (rate > 1) {
+        if (check_countdown > 0) {
+            check_countdown--;
+            return HEAPSTER_CHECK_OFF;
+        }
+        check_countdown = rate - 1;
+    }
+    return atomic_load_explicit(&check_level, memory_order_relaxed);
+}
+
+/*
+block'u verilen seviyede arm eder. canary icin requested_size'in arkasinda yer yoksa (realloc ile
+yerinde buyuyen block gibi) sadece header checksum'i kalir. kilit gerekmez, block henuz
+(ya da hala) sadece caller'in
+*/
+void check_arm(block_header_t *block, int level) {
+    if (level <= HEAPSTER_CHECK_OFF) {
+        block->check = 0;
+        return;
+    }
+
+    uint32_t check = check_header_sum(block);
+
+    if (level >= HEAPSTER_CHECK_CANARIES && block->size - block->requested_size >= CHECK_CANARY_SIZE) {
+        uint64_t canary = check_canary_value(block);
+        memcpy((char *)block_to_payload(block) + block->requested_size, &canary, sizeof(canary));
+        check |= CHECK_CANARY_BIT;
+    }
+
+    // heapster_check_heap canary'yi check'ten once gormeli
+    atomic_thread_fence(memory_order_release);
+    block->check = check;
+}
+
+// block arm edildigi seviye, realloc yerinde degisince ayni seviyede yeniden arm etmek icin
+int check_armed_level(const block_header_t *block) {
+    if (block->check == 0) {
+        return HEAPSTER_CHECK_OFF;
+    }
+    return (block->check & CHECK_CANARY_BIT) ? HEAPSTER_CHECK_CANARIES : HEAPSTER_CHECK_HEADERS;
+}
+
+// checksum ve canary tutuyor mu, tutmuyorsa raporlar. 0 = saglam
+static int check_verify(const block_header_t *block, const char *op) {
+    void *ptr = block_to_payload((block_header_t *)block);
+
+    if ((block->check & ~CHECK_CANARY_BIT) != check_header_sum(block)) {
+        check_report(op, ptr, "header corrupted");
+        return -1;
+    }
+
+    if (block->check & CHECK_CANARY_BIT) {
+        uint64_t canary;
+        memcpy(&canary, (const char *)ptr + block->requested_size, sizeof(canary));
+        if (canary != check_canary_value(block)) {
+            check_report(op, ptr, "buffer overrun");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+free ve realloc'tan once cagrilir, -1 donerse block'a dokunulmaz. magic tutmayan pointer'lari
+block_validate raporlar. block->free bakisi kontrol kapaliyken yapilmaz, eski davranis
+(validate'in -5'i) aynen kalir
+*/
+int check_before_free(block_header_t *block, const char *op) {
+    if (block->magic != CTRL_CHR) {
+        return 0;
+    }
+
+    if (atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF && block->free != 0) {
+        check_report(op, block_to_payload(block), "double free");
+        return -1;
+    }
+
+    if (block->check != 0 && block->free == 0) {
+        return check_verify(block, op);
+    }
+    return 0;
+}
+
+// tek arena, caller kilidi tutar. bulunan hata sayisini doner
+static int check_arena(arena_t *arena) {
+    int errors = 0;
+
+    uintptr_t raw = (uintptr_t)arena + ARENA_HEADER_SIZE;
+    block_header_t *block = (block_header_t *)((raw + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1));
+    block_header_t *prev = NULL;
+    int64_t blocks = 0;
+
+    while (block) {
+        if ((void *)block < arena->start || (char *)block + BLOCK_HEADER_SIZE > (char *)arena->end) {
+            fprintf(stderr, "[heapster] check: arena %llu block %p outside the arena\n",
+                    (unsigned long long)arena->id, (void *)block);
+            errors++;
+            break;
+        }
+
+        if (block->magic != CTRL_CHR) {
+            fprintf(stderr, "[heapster] check: arena %llu block %p bad magic\n",
+                    (unsigned long long)arena->id, (void *)block);
+            errors++;
+            break;  // size ve phys_next'e de guvenilemez
+        }
+
+        if (block->phys_prev != prev) {
+            fprintf(stderr, "[heapster] check: arena %llu block %p broken phys_prev link\n",
+                    (unsigned long long)arena->id, (void *)block);
+            errors++;
+        }
+
+        block_header_t *next = block->phys_next;
+        char *block_end = (char *)block + BLOCK_HEADER_SIZE + block->size;
+        if (block_end > (char *)arena->end || (next && (char *)next != block_end)) {
+            fprintf(stderr, "[heapster] check: arena %llu block %p size %zu does not reach the next block\n",
+                    (unsigned long long)arena->id, (void *)block, block->size);
+            errors++;
+            break;
+        }
+
+        if (block->free == 1) {
+            if (!block->prev && arena->free_list_head != block) {
+                fprintf(stderr, "[heapster] check: arena %llu free block %p not in the free list\n",
+                        (unsigned long long)arena->id, (void *)block);
+                errors++;
+            }
+        } else if (block->free == 0) {
+            if (block->check != 0 && check_verify(block, "check") != 0) {
+                errors++;
+            }
+        } else if (block->free != BLOCK_QUICK && block->free != BLOCK_TCACHE &&
+                   block->free != BLOCK_DEFERRED && block->free != BLOCK_REMOTE) {
+            fprintf(stderr, "[heapster] check: arena %llu block %p bad free flag %d\n",
+                    (unsigned long long)arena->id, (void *)block, block->free);
+            errors++;
+        }
+
+        blocks++;
+        prev = block;
+        block = next;
+    }
+
+    if (errors == 0 && blocks != arena->block_count) {
+        fprintf(stderr, "[heapster] check: arena %llu has %lld blocks, expected %lld\n",
+                (unsigned long long)arena->id, (long long)blocks, (long long)arena->block_count);
+        errors++;
+    }
+
+    return errors;
+}
+
+int heapster_check_heap(void) {
+    int errors = 0;
+
+    epoch_enter();
+
+    for (heapster_heap_t *heap = heap_registry_first(); heap; heap = heap->next) {
+        for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+            arena_lock(arena);
+            errors += check_arena(arena);
+            arena_unlock(arena);
+        }
+    }
+
+    epoch_exit();
+
+    return errors;
+}
@@ -0,0 +1,398 @@
+// config.c
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+ayarlar eskiden her dosyada ayri static degiskenlerdi ve sadece setter'larla degisiyordu,
+heapster_init'in arena_size'i da sadece ilk arenada kullaniliyordu. burada hepsi tek bir
+heapster_config_t ile verilir (heapster_init_with_config) ya da calisan binary'ye
+HEAPSTER_CONF ortam degiskeni ile gecilir:
+
+HEAPSTER_CONF="initial_arena_size:1M,growth_factor:2,max_arena_size:64M,policy:best_fit"
+HEAPSTER_CONF="check_level:canaries,check_sample_rate:100"
+HEAPSTER_CONF="profile_sample_bytes:512K,profile_signal:12"   (kill -USR2 ile dump)
+
+anahtarlar heapster_config_t alanlari ile ayni, boyutlarda K/M/G son eki kullanilabilir.
+HEAPSTER_CONF heapster_config_default icinde okunur, init hic cagrilmadiysa ilk malloc'ta bir
+kez uygulanir. parse sirasinda malloc yapilmaz (allocator kendini cagiramaz).
+
+arena buyumesi: yer bulunamayip yeni arena gerektiginde arena en az "sonraki adim" kadar
+alinir. adim initial_arena_size ile baslar, her yeni arenada growth_factor ile carpilir ve
+max_arena_size'da durur. tek bir istek adimdan buyukse arena istek kadar olur.
+
+heapster_heap_create ile olusturulan heap'ler de ayni heapster_config_t'yi alir, arena boyutu,
+buyume, policy, esikler ve bellek limitleri heap basina tutulur (config_apply_to_heap). check_*, profile_*,
+nontemporal_threshold, tcache_count ve deferred_* process genelidir, sadece varsayilan heap'in config'inden
+uygulanir.
+*/
+
+// varsayilan heap'e en son uygulanan config, heapster_get_config icin
+static heapster_config_t current_config;
+static _Atomic int config_loaded = 0;
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int parse_size(const char *s, size_t *out) {
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) {
+        return -1;
+    }
+
+    switch (*end) {
+        case 'k': case 'K': v <<= 10; end++; break;
+        case 'm': case 'M': v <<= 20; end++; break;
+        case 'g': case 'G': v <<= 30; end++; break;
+        default: break;
+    }
+
+    if (*end != '\0') {
+        return -1;
+    }
+    *out = (size_t)v;
+    return 0;
+}
+
+static int parse_policy(const char *s, heapster_policy_t *out) {
+    static const struct { const char *name; heapster_policy_t policy; } names[] = {
+        { "first_fit", HEAPSTER_FIRST_FIT },
+        { "next_fit",  HEAPSTER_NEXT_FIT  },
+        { "best_fit",  HEAPSTER_BEST_FIT  },
+        { "worst_fit", HEAPSTER_WORST_FIT },
+        { "adaptive",  HEAPSTER_ADAPTIVE  },
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(s, names[i].name) == 0) {
+            *out = names[i].policy;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_check_level(const char *s, heapster_check_level_t *out) {
+    static const struct { const char *name; heapster_check_level_t level; } names[] = {
+        { "off",      HEAPSTER_CHECK_OFF      },
+        { "headers",  HEAPSTER_CHECK_HEADERS  },
+        { "canaries", HEAPSTER_CHECK_CANARIES },
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(s, names[i].name) == 0) {
+            *out = names[i].level;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// tek bir "anahtar:deger" cifti, bilinmeyen ya da bozuk olan uyari verip atlanir
+static void config_apply_pair(heapster_config_t *cfg, const char *key, const char *value) {
+    size_t size = 0;
+    int bad = 0;
+
+    if (strcmp(key, "arena_count") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->arena_count = size;
+    } else if (strcmp(key, "initial_arena_size") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->initial_arena_size = size;
+    } else if (strcmp(key, "max_arena_size") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->max_arena_size = size;
+    } else if (strcmp(key, "growth_factor") == 0) {
+        char *end = NULL;
+        double f = strtod(value, &end);
+        bad = end == value || *end != '\0';
+        if (!bad) cfg->growth_factor = f;
+    } else if (strcmp(key, "mmap_threshold") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->mmap_threshold = size;
+    } else if (strcmp(key, "quick_max_size") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->quick_max_size = size;
+    } else if (strcmp(key, "quick_consolidate_threshold") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->quick_consolidate_threshold = size;
+    } else if (strcmp(key, "purge_decay_ms") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->purge_decay_ms = size;
+    } else if (strcmp(key, "policy") == 0) {
+        bad = parse_policy(value, &cfg->policy);
+    } else if (strcmp(key, "check_level") == 0) {
+        bad = parse_check_level(value, &cfg->check_level);
+    } else if (strcmp(key, "check_sample_rate") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->check_sample_rate = size;
+    } else if (strcmp(key, "profile_sample_bytes") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->profile_sample_bytes = size;
+    } else if (strcmp(key, "profile_signal") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->profile_signal = (int)size;
+    } else if (strcmp(key, "nontemporal_threshold") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->nontemporal_threshold = size;
+    } else if (strcmp(key, "tcache_count") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->tcache_count = (unsigned)size;
+    } else if (strcmp(key, "soft_limit") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->soft_limit = size;
+    } else if (strcmp(key, "hard_limit") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->hard_limit = size;
+    } else if (strcmp(key, "deferred_max_bytes") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->deferred_max_bytes = size;
+    } else if (strcmp(key, "deferred_thread") == 0) {
+        bad = parse_size(value, &size);
+        if (!bad) cfg->deferred_thread = size != 0;
+    } else {
+        fprintf(stderr, "[heapster] HEAPSTER_CONF: unknown key '%s'\n", key);
+        return;
+    }
+
+    if (bad) {
+        fprintf(stderr, "[heapster] HEAPSTER_CONF: bad value '%s' for '%s'\n", value, key);
+    }
+}
+
+// "k1:v1,k2:v2" formatindaki metni cfg uzerine yazar, 1 doner eger en az bir cift okunduysa
+int config_parse(heapster_config_t *cfg, const char *text) {
+    char key[64];
+    char value[64];
+    int applied = 0;
+
+    const char *p = text;
+    while (p && *p) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+
+        const char *colon = memchr(p, ':', len);
+        if (colon && (size_t)(colon - p) < sizeof(key) && len - (size_t)(colon - p) - 1 < sizeof(value)) {
+            size_t klen = (size_t)(colon - p);
+            size_t vlen = len - klen - 1;
+            memcpy(key, p, klen);
+            key[klen] = '\0';
+            memcpy(value, colon + 1, vlen);
+            value[vlen] = '\0';
+
+            config_apply_pair(cfg, key, value);
+            applied = 1;
+        } else if (len > 0) {
+            fprintf(stderr, "[heapster] HEAPSTER_CONF: cannot parse '%.*s'\n", (int)len, p);
+        }
+
+        p = comma ? comma + 1 : NULL;
+    }
+
+    return applied;
+}
+
+static void config_builtin_defaults(heapster_config_t *cfg) {
+    cfg->arena_count = 0;
+    cfg->initial_arena_size = 128 * 1024;
+    cfg->max_arena_size = 64 * 1024 * 1024;
+    cfg->growth_factor = 1.0;
+    cfg->mmap_threshold = 128 * 1024;
+    cfg->quick_max_size = QUICK_MAX_SIZE;
+    cfg->quick_consolidate_threshold = QUICK_CONSOLIDATE_THRESHOLD;
+    cfg->purge_decay_ms = 0;
+    cfg->policy = HEAPSTER_FIRST_FIT;
+    cfg->check_level = HEAPSTER_CHECK_OFF;
+    cfg->check_sample_rate = 1;
+    cfg->profile_sample_bytes = 0;
+    cfg->profile_signal = 0;
+    cfg->nontemporal_threshold = 2 * 1024 * 1024;
+    cfg->tcache_count = 32;
+    cfg->deferred_max_bytes = 64 * 1024 * 1024;
+    cfg->deferred_thread = 1;
+    cfg->soft_limit = 0;
+    cfg->hard_limit = 0;
+}
+
+void heapster_config_default(heapster_config_t *cfg) {
+    if (!cfg) {
+        return;
+    }
+
+    config_builtin_defaults(cfg);
+
+    const char *env = getenv("HEAPSTER_CONF");
+    if (env) {
+        config_parse(cfg, env);
+    }
+}
+
+// alanlari gecerli araliga ceker
+static void config_sanitize(heapster_config_t *cfg) {
+    if (cfg->initial_arena_size < ARENA_MIN_SIZE) {
+        cfg->initial_arena_size = ARENA_MIN_SIZE;
+    }
+    if (cfg->max_arena_size != 0 && cfg->max_arena_size < cfg->initial_arena_size) {
+        cfg->max_arena_size = cfg->initial_arena_size;
+    }
+    if (!(cfg->growth_factor >= 1.0)) {
+        cfg->growth_factor = 1.0;
+    }
+    if (cfg->quick_max_size > QUICK_MAX_SIZE) {
+        cfg->quick_max_size = QUICK_MAX_SIZE;
+    }
+    if (cfg->quick_consolidate_threshold == 0) {
+        cfg->quick_consolidate_threshold = 1;
+    }
+}
+
+// heap basina olan ayarlar, cfg NULL ise yerlesik varsayilanlar (HEAPSTER_CONF varsayilan heap icin)
+void config_apply_to_heap(heapster_heap_t *heap, const heapster_config_t *in) {
+    heapster_config_t cfg;
+    if (in) {
+        cfg = *in;
+    } else {
+        config_builtin_defaults(&cfg);
+    }
+    config_sanitize(&cfg);
+
+    atomic_store(&heap->next_arena_step, cfg.initial_arena_size);
+    heap->max_arena_size = cfg.max_arena_size;
+    heap->growth_factor = cfg.growth_factor;
+
+    heapster_heap_set_policy(heap, cfg.policy);
+    heap_set_mmap_threshold(heap, cfg.mmap_threshold);
+    arena_set_quick_limits(heap, cfg.quick_max_size, cfg.quick_consolidate_threshold);
+    arena_set_purge_decay(heap, cfg.purge_decay_ms);
+    heapster_heap_set_limits(heap, cfg.soft_limit, cfg.hard_limit);
+}
+
+static int config_apply(const heapster_config_t *in) {
+    heapster_config_t cfg = *in;
+    config_sanitize(&cfg);
+
+    pthread_mutex_lock(&config_lock);
+    current_config = cfg;
+    config_apply_to_heap(&heap_default, &cfg);
+    atomic_store_explicit(&config_loaded, 1, memory_order_release);
+    pthread_mutex_unlock(&config_lock);
+
+    heapster_set_check_level(cfg.check_level, cfg.check_sample_rate);
+
+    if (cfg.profile_sample_bytes != 0) {
+        heapster_profile_start(cfg.profile_sample_bytes);
+    } else {
+        heapster_profile_stop();
+    }
+    if (cfg.profile_signal != 0) {
+        heapster_profile_dump_on_signal(cfg.profile_signal, NULL);
+    }
+    heapster_set_nontemporal_threshold(cfg.nontemporal_threshold);
+    heapster_set_tcache_count(cfg.tcache_count);
+    heapster_set_deferred_max_bytes(cfg.deferred_max_bytes);
+    heapster_set_deferred_thread(cfg.deferred_thread);
+
+    int rc = 0;
+    for (size_t i = 0; i < cfg.arena_count; i++) {
+        if (!arena_create(&heap_default, config_next_arena_size(&heap_default, 0))) {
+            rc = -1;
+            break;
+        }
+    }
+    return rc;
+}
+
+int heapster_init_with_config(const heapster_config_t *cfg) {
+    heapster_config_t defaults;
+    if (!cfg) {
+        heapster_config_default(&defaults);
+        cfg = &defaults;
+    }
+    return config_apply(cfg);
+}
+
+void heapster_get_config(heapster_config_t *out) {
+    if (!out) {
+        return;
+    }
+
+    config_ensure_loaded();
+
+    pthread_mutex_lock(&config_lock);
+    *out = current_config;
+    pthread_mutex_unlock(&config_lock);
+
+    // setter'lar ile sonradan degismis olabilecekler
+    out->policy = heapster_get_policy();
+    out->mmap_threshold = heapster_get_mmap_threshold();
+    out->check_level = heapster_get_check_level();
+    out->check_sample_rate = heapster_get_check_sample_rate();
+    out->profile_sample_bytes = heapster_profile_get_sample_bytes();
+    out->profile_signal = profile_get_signal();
+    out->nontemporal_threshold = heapster_get_nontemporal_threshold();
+    out->tcache_count = heapster_get_tcache_count();
+    out->deferred_max_bytes = heapster_get_deferred_max_bytes();
+    out->deferred_thread = heapster_get_deferred_thread();
+    heapster_heap_get_limits(NULL, &out->soft_limit, &out->hard_limit);
+}
+
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+
+static void config_load_default(void) {
+    if (atomic_load(&config_loaded)) {
+        return;  // heapster_init_with_config once cagrilmis
+    }
+
+    // init'ten once setter'larla verilmis ayarlar ezilmesin, env sadece yazdigi anahtarlari degistirir
+    heapster_config_t cfg;
+    config_builtin_defaults(&cfg);
+    cfg.policy = heapster_get_policy();
+    cfg.mmap_threshold = heapster_get_mmap_threshold();
+    cfg.check_level = heapster_get_check_level();
+    cfg.check_sample_rate = heapster_get_check_sample_rate();
+    cfg.profile_sample_bytes = heapster_profile_get_sample_bytes();
+    cfg.profile_signal = profile_get_signal();
+    cfg.nontemporal_threshold = heapster_get_nontemporal_threshold();
+    cfg.tcache_count = heapster_get_tcache_count();
+    cfg.deferred_max_bytes = heapster_get_deferred_max_bytes();
+    cfg.deferred_thread = heapster_get_deferred_thread();
+    heapster_heap_get_limits(NULL, &cfg.soft_limit, &cfg.hard_limit);
+
+    const char *env = getenv("HEAPSTER_CONF");
+    if (env) {
+        config_parse(&cfg, env);
+    }
+    config_apply(&cfg);
+}
+
+// init cagrilmadiysa ilk malloc'ta varsayilanlar + HEAPSTER_CONF bir kez uygulanir
+void config_ensure_loaded(void) {
+    if (atomic_load_explicit(&config_loaded, memory_order_acquire)) {
+        return;
+    }
+    pthread_once(&config_once, config_load_default);
+}
+
+/*
+heap'in yeni arenasi icin boyut: needed ile o anki adimin buyugu. adim her cagrida growth_factor
+ile buyur ve max_arena_size'i gecmez
+*/
+size_t config_next_arena_size(heapster_heap_t *heap, size_t needed) {
+    size_t step = atomic_load_explicit(&heap->next_arena_step, memory_order_relaxed);
+    size_t grown = (size_t)((double)step * heap->growth_factor);
+    if (heap->max_arena_size != 0 && grown > heap->max_arena_size) {
+        grown = heap->max_arena_size;
+    }
+    if (grown < step) {
+        grown = step;
+    }
+
+    // yarisan threadlerden biri ilerletir, digeri ayni adimi kullanir, sorun degil
+    atomic_compare_exchange_strong(&heap->next_arena_step, &step, grown);
+
+    return needed > step ? needed : step;
+}
@@ -0,0 +1,436 @@
+// deferred.c
+#include <errno.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+hizli bir heapster_free bile coalesce, stat guncellemesi, arena kilidi ve bazen arena_destroy
+(munmap / sbrk) yapiyor. gecikmeye hassas threadler icin heapster_free_deferred: pointer sadece
+kuyruga girer, asil free baska bir yerde toplu halde yapilir.
+
+- her thread'in kendi zinciri var (block->next ile bagli, kilitsiz cunku sadece sahibi dokunur).
+  DEFERRED_BATCH block ya da DEFERRED_BATCH_BYTES byte birikince zincir tek CAS ile global
+  batch stack'ine itilir. batch'ler birbirine bas blockun prev alani ile baglanir (allocated
+  blockta prev kullanilmiyor)
+- stack bosken itilen batch reclaimer thread'ini uyandirir (semaphore, profile.c'deki dumper
+  gibi). reclaimer stack'i tek exchange ile alir, blocklari (arena id, adres) sirasina dizer ve
+  her arenanin blocklarini tek kilit altinda free eder. reclaimer sahibi olmadigi arenalari da
+  kilitle free eder, remote queue'ya atmaz (yoksa is yine sahibine kalirdi)
+- heapster_deferred_flush cagiran thread'in zincirini iter ve kuyrugun tamamini cagiranin
+  thread'inde free eder, deferred_thread kapaliyken "bos zamanda" cagrilacak olan bu
+- kuyruktaki toplam byte deferred_max_bytes'i gececekse pointer o an normal yoldan free edilir,
+  kuyruk sinirsiz buyumez. 0 ile deferral tamamen kapanir
+- kuyruktaki block arena icin hala allocated (arena destroy edilemez), block->free =
+  BLOCK_DEFERRED, ikinci free / realloc block_validate'te reddedilir
+- thread cikarken zinciri stack'e itilir. finalize kuyrugu birakir, generation artar, diger
+  threadlerin zincirleri bir sonraki kullanimda unutulur (tcache.c ile ayni)
+- her heap kuyruktaki block sayisini tutar (heap->deferred_blocks). heapster_heap_destroy
+  baska bir thread'in zincirinde hala o heap'ten block varken heap'i yok etmez. shared heap
+  blocklari kuyruga hic girmez
+*/
+
+#define DEFERRED_BATCH 64
+#define DEFERRED_BATCH_BYTES (256 * 1024)
+
+typedef struct {
+    block_header_t *head;
+    unsigned count;
+    size_t bytes;
+    unsigned generation;
+    int registered;
+} deferred_chain_t;
+
+static _Thread_local deferred_chain_t deferred_chain;
+
+static _Atomic(block_header_t *) deferred_stack;
+static _Atomic size_t deferred_queued_bytes;
+static _Atomic unsigned deferred_generation = 1;
+
+static _Atomic size_t deferred_max_bytes = 64 * 1024 * 1024;
+static _Atomic int deferred_thread_enabled = 1;
+static _Atomic int deferred_thread_running;
+
+static _Atomic uint64_t deferred_freed;
+static _Atomic uint64_t deferred_batches;
+static _Atomic uint64_t deferred_inline;
+
+// reclaim (thread ya da flush) ve finalize'daki birakma birbirini bekler
+static pthread_mutex_t deferred_lock = PTHREAD_MUTEX_INITIALIZER;
+static sem_t deferred_sem;
+
+static pthread_key_t deferred_key;
+static pthread_once_t deferred_once = PTHREAD_ONCE_INIT;
+
+void heapster_set_deferred_max_bytes(size_t bytes) {
+    atomic_store(&deferred_max_bytes, bytes);
+}
+
+size_t heapster_get_deferred_max_bytes(void) {
+    return atomic_load(&deferred_max_bytes);
+}
+
+void heapster_set_deferred_thread(int enabled) {
+    atomic_store(&deferred_thread_enabled, enabled ? 1 : 0);
+
+    // kapaliyken birikmis batch'ler icin calisan thread'i uyandir
+    if (enabled && atomic_load(&deferred_thread_running)) {
+        sem_post(&deferred_sem);
+    }
+}
+
+int heapster_get_deferred_thread(void) {
+    return atomic_load(&deferred_thread_enabled);
+}
+
+// finalize'dan sonra eski zincirdeki blocklarin arenalari yok, zincir unutulur
+static inline void deferred_stale(void) {
+    unsigned gen = atomic_load_explicit(&deferred_generation, memory_order_acquire);
+    if (__builtin_expect(deferred_chain.generation != gen, 0)) {
+        deferred_chain.head = NULL;
+        deferred_chain.count = 0;
+        deferred_chain.bytes = 0;
+        deferred_chain.generation = gen;
+    }
+}
+
+// (arena id, adres) sirali birlestirme, ayni arenanin blocklari yan yana gelir
+static block_header_t *deferred_merge(block_header_t *a, block_header_t *b) {
+    block_header_t head;
+    block_header_t *tail = &head;
+
+    while (a && b) {
+        int take_a = a->arena_id != b->arena_id ? a->arena_id < b->arena_id : a < b;
+        if (take_a) {
+            tail->next = a;
+            a = a->next;
+        } else {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = a ? a : b;
+    return head.next;
+}
+
+static block_header_t *deferred_sort(block_header_t *list) {
+    if (!list || !list->next) {
+        return list;
+    }
+
+    block_header_t *slow = list;
+    for (block_header_t *fast = list->next; fast && fast->next; fast = fast->next->next) {
+        slow = slow->next;
+    }
+    block_header_t *second = slow->next;
+    slow->next = NULL;
+
+    return deferred_merge(deferred_sort(list), deferred_sort(second));
+}
+
+/*
+run ayni arena id'li blocklarin zinciri. heap_free'nin 0. ve 2.-4. adimlari, tek fark kilit
+run basina bir kez alinir ve sahiplik kontrolu yok
+*/
+static void deferred_free_run(block_header_t *run) {
+    int id = run->arena_id;
+
+    epoch_enter();
+
+    arena_t *arena = arena_find_by_id(id);
+    if (!arena) {
+        epoch_exit();
+        fprintf(stderr, "[heapster] free_deferred: arena %d of block %p not found\n", id, (void *)run);
+        return;
+    }
+
+    heapster_heap_t *heap = arena->heap;
+    int destroy = 0;
+    uint64_t freed = 0;
+
+    arena_lock(arena);
+    arena_drain_remote_frees(arena);
+
+    while (run && !destroy) {
+        block_header_t *next = run->next;
+        run->next = NULL;
+        run->prev = NULL;
+        run->free = 0;
+        atomic_fetch_sub_explicit(&heap->deferred_blocks, 1, memory_order_relaxed);
+
+        // integrity check bozuk blocku leak eder, heap_free ile ayni
+        if (__builtin_expect(atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF ||
+                             run->check != 0, 0) &&
+            check_before_free(run, "free_deferred") != 0) {
+            run = next;
+            continue;
+        }
+        if (__builtin_expect(atomic_load_explicit(&profile_live_samples, memory_order_relaxed) != 0, 0)) {
+            profile_forget(block_to_payload(run));
+        }
+
+        destroy = arena_free_block(arena, run);
+        freed++;
+        run = next;
+    }
+
+    if (!destroy) {
+        arena_maybe_purge(arena);
+    }
+
+    arena_unlock(arena);
+
+    if (destroy) {
+        arena_destroy(arena);
+    }
+
+    epoch_exit();
+    arena_collect_retired(heap);
+
+    atomic_fetch_add_explicit(&deferred_freed, freed, memory_order_relaxed);
+}
+
+// caller deferred_lock'u tutuyor. stack'teki her sey free edilir
+static void deferred_reclaim_locked(void) {
+    block_header_t *batch = atomic_exchange_explicit(&deferred_stack, NULL, memory_order_acquire);
+    if (!batch) {
+        return;
+    }
+
+    // batch'leri tek zincirde topla
+    block_header_t *list = NULL;
+    size_t bytes = 0;
+    uint64_t batches = 0;
+    while (batch) {
+        block_header_t *next_batch = batch->prev;
+        block_header_t *block = batch;
+        while (block) {
+            block_header_t *next = block->next;
+            bytes += block->size;
+            block->next = list;
+            list = block;
+            block = next;
+        }
+        batch = next_batch;
+        batches++;
+    }
+    atomic_fetch_add_explicit(&deferred_batches, batches, memory_order_relaxed);
+
+    list = deferred_sort(list);
+
+    while (list) {
+        block_header_t *run = list;
+        block_header_t *last = list;
+        while (last->next && last->next->arena_id == run->arena_id) {
+            last = last->next;
+        }
+        list = last->next;
+        last->next = NULL;
+
+        deferred_free_run(run);
+    }
+
+    atomic_fetch_sub_explicit(&deferred_queued_bytes, bytes, memory_order_relaxed);
+}
+
+static void *deferred_reclaimer(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        if (sem_wait(&deferred_sem) != 0) {
+            continue;  // EINTR
+        }
+        pthread_mutex_lock(&deferred_lock);
+        deferred_reclaim_locked();
+        pthread_mutex_unlock(&deferred_lock);
+    }
+    return NULL;
+}
+
+static void deferred_destructor(void *arg);
+
+static void deferred_init_once(void) {
+    sem_init(&deferred_sem, 0, 0);
+    pthread_key_create(&deferred_key, deferred_destructor);
+}
+
+// thread ilk kez gerektiginde baslar. stack'te zaten bekleyen batch olabilir (fork sonrasi), bir kez uyandirilir
+static void deferred_start_thread(void) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&deferred_thread_running, &expected, 1)) {
+        return;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, deferred_reclaimer, NULL) != 0) {
+        atomic_store(&deferred_thread_running, 0);
+        return;
+    }
+    pthread_detach(tid);
+    sem_post(&deferred_sem);
+}
+
+// bu thread'in zinciri tek batch olarak global stack'e
+static void deferred_push_chain(void) {
+    block_header_t *batch = deferred_chain.head;
+    if (!batch) {
+        return;
+    }
+    deferred_chain.head = NULL;
+    deferred_chain.count = 0;
+    deferred_chain.bytes = 0;
+
+    block_header_t *top = atomic_load_explicit(&deferred_stack, memory_order_relaxed);
+    do {
+        batch->prev = top;
+    } while (!atomic_compare_exchange_weak_explicit(&deferred_stack, &top, batch,
+                                                    memory_order_release, memory_order_relaxed));
+
+    if (atomic_load_explicit(&deferred_thread_enabled, memory_order_relaxed)) {
+        if (__builtin_expect(!atomic_load_explicit(&deferred_thread_running, memory_order_relaxed), 0)) {
+            deferred_start_thread();
+        } else if (!top) {
+            sem_post(&deferred_sem);
+        }
+    }
+}
+
+static void deferred_destructor(void *arg) {
+    (void)arg;
+    deferred_stale();
+    deferred_push_chain();
+}
+
+void heapster_free_deferred(void *ptr) {
+    if (!ptr) return;
+
+    // rt havuzuna donus zaten sabit sureli
+    if (rt_owns(ptr)) {
+        rt_free(ptr);
+        return;
+    }
+
+    block_header_t *block = payload_to_block(ptr);
+    if (block_validate(block) <= 0) {
+        fprintf(stderr, "[heapster] free_deferred: invalid free %p\n", ptr);
+        return;
+    }
+
+    size_t max = atomic_load_explicit(&deferred_max_bytes, memory_order_relaxed);
+    if (max == 0) {
+        heapster_free(ptr);
+        return;
+    }
+
+    // heap'in sayaci destroy'un baska threadlerin zincirlerindeki blocklari gormesi icin. shared
+    // heap'in struct'i process'ler arasi ortak, sayac process basina tutulamaz: onlar hemen free
+    epoch_enter();
+    arena_t *arena = arena_find_by_id(block->arena_id);
+    if (!arena || arena->is_shared) {
+        epoch_exit();
+        heapster_free(ptr);
+        return;
+    }
+    heapster_heap_t *heap = arena->heap;
+    epoch_exit();
+
+    // sinir asilacaksa kuyruga girmez, bu seferlik normal free
+    size_t queued = atomic_fetch_add_explicit(&deferred_queued_bytes, block->size, memory_order_relaxed);
+    if (queued + block->size > max) {
+        atomic_fetch_sub_explicit(&deferred_queued_bytes, block->size, memory_order_relaxed);
+        atomic_fetch_add_explicit(&deferred_inline, 1, memory_order_relaxed);
+        heapster_free(ptr);
+        return;
+    }
+
+    deferred_stale();
+    if (__builtin_expect(!deferred_chain.registered, 0)) {
+        pthread_once(&deferred_once, deferred_init_once);
+        pthread_setspecific(deferred_key, &deferred_chain);
+        deferred_chain.registered = 1;
+    }
+
+    atomic_fetch_add_explicit(&heap->deferred_blocks, 1, memory_order_relaxed);
+    block->free = BLOCK_DEFERRED;
+    block->next = deferred_chain.head;
+    deferred_chain.head = block;
+    deferred_chain.count++;
+    deferred_chain.bytes += block->size;
+
+    if (deferred_chain.count >= DEFERRED_BATCH || deferred_chain.bytes >= DEFERRED_BATCH_BYTES) {
+        deferred_push_chain();
+    }
+}
+
+void heapster_deferred_flush(void) {
+    deferred_stale();
+    deferred_push_chain();
+
+    if (!atomic_load_explicit(&deferred_stack, memory_order_relaxed)) {
+        return;
+    }
+
+    pthread_mutex_lock(&deferred_lock);
+    deferred_reclaim_locked();
+    pthread_mutex_unlock(&deferred_lock);
+}
+
+// heap_release_all'dan: kuyruktaki blocklarin arenalari birazdan geri verilecek
+void deferred_invalidate_all(void) {
+    pthread_mutex_lock(&deferred_lock);
+    atomic_store(&deferred_stack, NULL);
+    atomic_store(&deferred_queued_bytes, 0);
+    atomic_fetch_add(&deferred_generation, 1);
+
+    // eski zincirler artik hic yurunmeyecek, heap'ler destroy edilebilir
+    for (heapster_heap_t *heap = heap_registry_first(); heap; heap = heap->next) {
+        atomic_store(&heap->deferred_blocks, 0);
+    }
+    pthread_mutex_unlock(&deferred_lock);
+    deferred_stale();
+}
+
+/*
+heapster_heap_destroy'dan: bu thread'in zinciri ve global stack free edilir. baska bir thread'in
+zincirinde hala bu heap'ten block varsa 0 doner, heap yok edilmemeli (o zincir arenalar
+unmap edildikten sonra yurunurdu)
+*/
+int deferred_release_heap(heapster_heap_t *heap) {
+    if (!atomic_load(&heap->deferred_blocks)) {
+        return 1;
+    }
+    heapster_deferred_flush();
+    return atomic_load(&heap->deferred_blocks) == 0;
+}
+
+// fork.c: reclaimer bir batch'in ortasindayken fork olmasin
+void deferred_lock_for_fork(void) {
+    pthread_mutex_lock(&deferred_lock);
+}
+
+void deferred_unlock_for_fork(void) {
+    pthread_mutex_unlock(&deferred_lock);
+}
+
+/*
+child'da reclaimer yok. stack'te kalan batch'ler child'in kopyasinda gecerli, bir sonraki push
+thread'i yeniden baslatir (ya da flush free eder)
+*/
+void deferred_reinit_after_fork(void) {
+    pthread_mutex_init(&deferred_lock, NULL);
+    atomic_store(&deferred_thread_running, 0);
+    sem_init(&deferred_sem, 0, 0);
+}
+
+void deferred_dump(void) {
+    printf("deferred free  : %zu bytes queued (max %zu), %llu freed in %llu batches, %llu inline (over max)\n",
+           atomic_load(&deferred_queued_bytes), heapster_get_deferred_max_bytes(),
+           (unsigned long long)atomic_load(&deferred_freed),
+           (unsigned long long)atomic_load(&deferred_batches),
+           (unsigned long long)atomic_load(&deferred_inline));
+}
@@ -0,0 +1,158 @@
+// epoch.c
+#include <sched.h>
+
+#include "internal.h"
+#include "internal_f.h"
+
+/*
+Bu dosya ne ise yarar?
+heapster_malloc arena listesini (arena_get_list(heap), arena->next) kilitsiz geziyordu ama ayni anda
+arena_destroy bir arenayi listeden cikarip munmap edebiliyordu, gezen thread unmap edilmis
+bir header'i okuyabilirdi (use-after-unmap). her malloc'ta global lock almamak icin epoch
+tabanli guvenli geri kazanim (EBR) kullanilir:
+
+- okuyucu listeyi gezmeden once epoch_enter ile o anki global epoch'u kendi slotuna yazar,
+  isi bitince epoch_exit ile slotu sifirlar (0 = liste ile isi yok). ic ice cagrilabilir.
+- yazici (heap->list_lock altinda) arenayi listeden cikarir, global epoch'u bir artirir ve
+  arenayi o epoch ile retired listesine koyar.
+- retired bir arena, aktif her okuyucunun slotu arenanin epoch'una esit ya da buyuk oldugunda
+  (yani cikarildiktan sonra girmis olduklarinda) geri verilir. o okuyucular artik ona ulasamaz.
+
+slot yazma, fence ve slot okuma seq_cst oldugu icin: yazici slotu 0 gordugu bir okuyucu,
+listeyi mutlaka cikarma isleminden sonra okur.
+
+slotlar sabit bir dizi (allocator kendi icinden malloc cagiramaz). thread ilk girisinde bir slot
+kapar ve thread bitince pthread key destructor ile birakir. slot kalmadiysa okuyucu
+overflow_readers sayacina yazilir, o sayac sifir olmadan hicbir sey geri verilmez.
+*/
+
+#define EPOCH_MAX_THREADS 256
+
+typedef struct {
+    alignas(HEAPSTER_CACHE_LINE) _Atomic uint64_t epoch; // 0 = okuyucu degil
+    _Atomic int in_use;
+} epoch_slot_t;
+
+static epoch_slot_t epoch_slots[EPOCH_MAX_THREADS];
+static _Atomic uint64_t global_epoch = 1;
+static _Atomic uint64_t overflow_readers = 0;
+
+static _Thread_local int my_slot = -1;       // -1 = henuz slot yok, -2 = slot bulunamadi (overflow)
+static _Thread_local unsigned read_depth = 0;
+
+static pthread_once_t epoch_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t epoch_key;
+
+/*
+thread biterken slot birakilir. sonra calisan baska destructor'lar (tcache.c'nin flush'i gibi,
+glibc key olusturma sirasiyla cagiriyor) hala epoch_enter yapabilir: slot baska bir thread'e
+gecmis olabilecegi icin thread-local durum da sifirlanir, epoch_enter yeni slot kapar ve key
+tekrar set edildigi icin o slot da bir sonraki destructor turunda birakilir
+*/
+static void epoch_thread_exit(void *value) {
+    int slot = (int)(uintptr_t)value - 1;
+    if (slot >= 0 && slot < EPOCH_MAX_THREADS) {
+        atomic_store(&epoch_slots[slot].epoch, 0);
+        atomic_store(&epoch_slots[slot].in_use, 0);
+    }
+    my_slot = -1;
+    read_depth = 0;
+}
+
+static void epoch_key_init(void) {
+    pthread_key_create(&epoch_key, epoch_thread_exit);
+}
+
+static int epoch_claim_slot(void) {
+    pthread_once(&epoch_key_once, epoch_key_init);
+
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        int expected = 0;
+        if (atomic_load_explicit(&epoch_slots[i].in_use, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_strong(&epoch_slots[i].in_use, &expected, 1)) {
+            pthread_setspecific(epoch_key, (void *)(uintptr_t)(i + 1));
+            return i;
+        }
+    }
+    return -2;
+}
+
+void epoch_enter(void) {
+    if (read_depth++ > 0) {
+        return;
+    }
+
+    if (my_slot == -1) {
+        my_slot = epoch_claim_slot();
+    }
+
+    if (my_slot >= 0) {
+        atomic_store(&epoch_slots[my_slot].epoch, atomic_load(&global_epoch));
+    } else {
+        atomic_fetch_add(&overflow_readers, 1);
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void epoch_exit(void) {
+    if (read_depth == 0 || --read_depth > 0) {
+        return;
+    }
+
+    if (my_slot >= 0) {
+        atomic_store_explicit(&epoch_slots[my_slot].epoch, 0, memory_order_release);
+    } else {
+        atomic_fetch_sub(&overflow_readers, 1);
+    }
+}
+
+// caller bir okuma bolumunun icinde mi, icindeyse kendi epoch'u geri kazanimi bloklar
+int epoch_in_read_section(void) {
+    return read_depth > 0;
+}
+
+// listeden cikarma isleminden sonra cagrilir, donen deger arenanin retire epoch'u
+uint64_t epoch_advance(void) {
+    return atomic_fetch_add(&global_epoch, 1) + 1;
+}
+
+// retire_epoch'tan once girmis ve hala aktif okuyucu var mi
+int epoch_is_safe(uint64_t retire_epoch) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load(&overflow_readers) != 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        uint64_t e = atomic_load(&epoch_slots[i].epoch);
+        if (e != 0 && e < retire_epoch) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// retire_epoch'tan once baslamis tum okuyucular cikana kadar bekler (finalize gibi yavas yollar icin)
+void epoch_synchronize(uint64_t retire_epoch) {
+    while (!epoch_is_safe(retire_epoch)) {
+        sched_yield();
+    }
+}
+
+/*
+fork sonrasi child'da sadece fork eden thread yasar. diger threadlerin slotlari bir daha hic
+bosalmayacagi icin geri kazanimi sonsuza kadar bloklardi, hepsi temizlenir. kendi slotumuz
+(okuma bolumunde olabiliriz) oldugu gibi kalir
+*/
+void epoch_reset_after_fork(void) {
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        if (i == my_slot) {
+            continue;
+        }
+        atomic_store(&epoch_slots[i].epoch, 0);
+        atomic_store(&epoch_slots[i].in_use, 0);
+    }
+
+    atomic_store(&overflow_readers, (my_slot == -2 && read_depth > 0) ? 1 : 0);
+}
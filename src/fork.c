@@ -0,0 +1,55 @@
+// fork.c
+#include <pthread.h>
+
+#include "internal.h"
+#include "internal_f.h"
+
+/*
+Bu dosya ne ise yarar?
+fork() sadece cagiran thread'i kopyalar. o an baska bir thread bir heap'in list_lock'unu
+ya da bir arenanin kilidini tutuyorsa child'da o kilit sonsuza kadar kilitli kalir ve ilk
+malloc'ta child kilitlenirdi. pthread_atfork ile:
+
+prepare -> fork'tan hemen once tum heapster kilitleri alinir, fork sirasinda heap tutarlidir
+parent  -> hepsi ters sirayla birakilir
+child   -> kilitler bastan kurulur (kilidi alan thread child'da yok, unlock yerine init),
+           olmayan threadlerin epoch slotlari temizlenir, arenalarin sahibi child'daki tek
+           thread olur ki free'ler remote queue'da beklemesin
+
+kilit sirasi kodun geri kalaniyla ayni: heap registry -> heap->list_lock -> arena->lock. rt havuzunun ve
+profiler'in kilitleri digerleriyle hic ic ice alinmadigi icin en basta alinir. deferred free
+reclaimer'inin kilidi arena kilitlerinin disinda tutuldugu icin hepsinden once
+*/
+
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+static void fork_prepare(void) {
+    deferred_lock_for_fork();
+    profile_lock();
+    rt_lock();
+    heap_fork_prepare();
+}
+
+static void fork_parent(void) {
+    heap_fork_parent();
+    rt_unlock();
+    profile_unlock();
+    deferred_unlock_for_fork();
+}
+
+static void fork_child(void) {
+    heap_fork_child();
+    epoch_reset_after_fork();
+    rt_reinit_after_fork();
+    profile_reinit_after_fork();
+    deferred_reinit_after_fork();
+}
+
+static void fork_register(void) {
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+// ilk arena olusturulurken bir kez cagrilir
+void fork_handlers_install(void) {
+    pthread_once(&fork_once, fork_register);
+}
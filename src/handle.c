@@ -0,0 +1,107 @@
+// handle.c
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+graph / trie gibi yapilarda node'larin buyuk kismi 8 byte'lik pointer. burada tek bir bitisik
+araliga yayilmis tek arenali bir heap var, allocation'lar pointer yerine 32 bit handle olarak
+verilir: handle = (payload - arena basi) / ALIGNMENT. payload'lar ALIGNMENT'a hizali ve arena
+basi sayfa hizali oldugu icin bolme tam, cozmek tek bir carpma + toplama (heapster_handle_ptr,
+header'da inline). 32 bit * 16 byte hizalama ile 64 GiB'a kadar heap adreslenebilir.
+
+- aralik baslangicta bir kerede MAP_NORESERVE ile alinir, sayfalar dokunuldukca gelir.
+  arena_format ile tek bir buyuk free block olarak kurulur, heap sabit boyutlu (buyumez,
+  dolunca handle 0 doner) ve arena hic destroy edilmez, yani arena->start hic degismez
+- handle 0 hicbir zaman verilmez (arena header'i offset 0'da), null handle olarak kullanilir
+- malloc / free / policy / stat yolu normal heap'lerle ayni, handle sadece giris cikista
+  pointer'a cevrilir. heapster_heap_malloc ile alinan pointer da heapster_handle_of ile
+  handle'a cevrilebilir
+*/
+
+#define HANDLE_MAX_SIZE (((size_t)UINT32_MAX + 1) * ALIGNMENT)
+
+heapster_heap_t *heapster_heap_create_handles(size_t size) {
+    size_t page_size = (size_t)sysconf(_SC_PAGE_SIZE);
+
+    if (size == 0 || size > HANDLE_MAX_SIZE) {
+        size = HANDLE_MAX_SIZE;
+    }
+    if (size < ARENA_MIN_SIZE) {
+        size = ARENA_MIN_SIZE;
+    }
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if (size > HANDLE_MAX_SIZE) {
+        size = HANDLE_MAX_SIZE;
+    }
+
+    void *region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        fprintf(stderr, "[heapster] heap_create_handles: cannot reserve %zu bytes\n", size);
+        return NULL;
+    }
+
+    heapster_heap_t *heap = heapster_heap_create(NULL);
+    if (!heap) {
+        munmap(region, size);
+        return NULL;
+    }
+    heap->fixed_size = 1;
+    strncpy(heap->name, "handles", sizeof(heap->name) - 1);
+
+    // arena mmap'li sayilir, heapster_heap_destroy araligin tamamini tek munmap ile geri verir
+    arena_t *arena = arena_format(heap, region, size);
+    if (!arena) {
+        heapster_heap_destroy(heap);
+        munmap(region, size);
+        return NULL;
+    }
+
+    heap->handle_base = region;
+    arena_publish(arena);
+
+    return heap;
+}
+
+void *heapster_handle_base(heapster_heap_t *heap) {
+    return heap ? heap->handle_base : NULL;
+}
+
+heapster_handle_t heapster_handle_of(heapster_heap_t *heap, const void *ptr) {
+    if (!heap || !heap->handle_base || !ptr) {
+        return 0;
+    }
+
+    uintptr_t off = (uintptr_t)ptr - (uintptr_t)heap->handle_base;
+    if ((uintptr_t)ptr < (uintptr_t)heap->handle_base || off >= HANDLE_MAX_SIZE || off % ALIGNMENT != 0) {
+        return 0;
+    }
+    return (heapster_handle_t)(off / ALIGNMENT);
+}
+
+heapster_handle_t heapster_handle_malloc(heapster_heap_t *heap, size_t size) {
+    if (!heap || !heap->handle_base) {
+        return 0;
+    }
+    return heapster_handle_of(heap, heapster_heap_malloc(heap, size));
+}
+
+heapster_handle_t heapster_handle_calloc(heapster_heap_t *heap, size_t nmemb, size_t size) {
+    if (!heap || !heap->handle_base) {
+        return 0;
+    }
+    return heapster_handle_of(heap, heapster_heap_calloc(heap, nmemb, size));
+}
+
+void heapster_handle_free(heapster_heap_t *heap, heapster_handle_t handle) {
+    if (!heap || !heap->handle_base || handle == 0) {
+        return;
+    }
+    heapster_heap_free(heap, heapster_handle_ptr(heap->handle_base, handle));
+}
@@ -0,0 +1,300 @@
+// heap.c
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+arena listesi, policy ve esikler eskiden arena.c'de global'di, process'teki her alt sistem ayni
+heap'i paylasiyordu: gurultulu bir alt sistem latency'ye hassas olanin arenalarini parcaliyor
+ve ayni arena kilitlerinde yarisiyordu. burada heapster_heap_t ile bagimsiz heap'ler var:
+
+- heap_default: heapster_malloc & co.'nun kullandigi heap, static olarak kurulu
+- heapster_heap_create: kendi arena listesi, policy'si, esikleri ve statlari olan yeni heap.
+  struct'i (allocator kendini cagiramadigi icin) ayri bir mmap'te durur
+- registry: varsayilan heap en basta, olusturulanlar arkasinda. free edilen pointer'in arenasi
+  (arena_find_by_id) tum heap'lerde aranir, okuyucular registry'yi kilitsiz gezer
+- heapster_heap_destroy: heap registry'den ve arenalari listeden cikarilir, okuyucular
+  cikinca hepsi tek seferde munmap edilir. olusturulan heap'lerin arenalari hep mmap oldugu
+  icin (arena_create_ex) sbrk'nin ortasinda kalan arena olmaz
+- hint heap'leri: heapster_malloc_hint omru belli allocation'lari ayri heap'lere yollar ki
+  uzun yasayan tek bir block kisa omurlulerin arenasini bosalmaktan alikoymasin (asagida)
+*/
+
+heapster_heap_t heap_default = {
+    .arena_list_head = NULL,
+    .list_lock = PTHREAD_MUTEX_INITIALIZER,
+    .retired_list_head = NULL,
+    .retired_pending = 0,
+    .policy = HEAPSTER_FIRST_FIT,
+    .mmap_threshold = 128 * 1024,
+    .deferred_coalesce_default = 0,
+    .quick_max_size = QUICK_MAX_SIZE,
+    .quick_consolidate_threshold = QUICK_CONSOLIDATE_THRESHOLD,
+    .purge_decay_ms = 0,
+    .next_arena_step = 128 * 1024,
+    .max_arena_size = 64 * 1024 * 1024,
+    .growth_factor = 1.0,
+    .is_default = 1,
+    .next = NULL,
+};
+
+// registry'ye ekleme/cikarma (heap->next yazmak) bu kilitle, okumak kilitsiz
+static pthread_mutex_t heap_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// caller epoch_enter / epoch_exit arasinda olmali (ya da heap_registry_lock'u tutmali)
+heapster_heap_t *heap_registry_first(void) {
+    return &heap_default;
+}
+
+static size_t heap_struct_size(void) {
+    size_t page_size = (size_t)sysconf(_SC_PAGE_SIZE);
+    return (sizeof(heapster_heap_t) + page_size - 1) & ~(page_size - 1);
+}
+
+heapster_heap_t *heapster_heap_create(const heapster_config_t *cfg) {
+    fork_handlers_install();
+
+    heapster_heap_t *heap = mmap(NULL, heap_struct_size(),
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS,
+                                 -1, 0);
+    if (heap == MAP_FAILED) {
+        return NULL;
+    }
+
+    // mmap sifirli gelir, listeler bos ve retired_pending 0
+    pthread_mutex_init(&heap->list_lock, NULL);
+    heap->deferred_coalesce_default = heap_default.deferred_coalesce_default;
+    heap->is_default = 0;
+    config_apply_to_heap(heap, cfg);
+
+    // arenalar heap yayinlanmadan olusturulur, kimse henuz bu heap'ten pointer alamaz
+    size_t arena_count = cfg ? cfg->arena_count : 0;
+    for (size_t i = 0; i < arena_count; i++) {
+        if (!arena_create(heap, config_next_arena_size(heap, 0))) {
+            arena_release_all(heap);
+            pthread_mutex_destroy(&heap->list_lock);
+            munmap(heap, heap_struct_size());
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&heap_registry_lock);
+    heap->next = atomic_load(&heap_default.next);
+    atomic_store(&heap_default.next, heap);
+    pthread_mutex_unlock(&heap_registry_lock);
+
+    return heap;
+}
+
+/*
+heap registry'den cikarilir ve tum arenalari geri verilir. heap'ten alinmis tum pointer'lar
+gecersiz olur, ayni anda bu heap'i kullanan thread olmamali. varsayilan heap yok edilemez
+(heapster_finalize). okuma bolumu icinden cagrilmamali
+*/
+void heapster_heap_destroy(heapster_heap_t *heap) {
+    if (!heap || heap == &heap_default) {
+        return;
+    }
+
+    // bu heap'in kuyrukta bekleyen deferred free'leri arenalar gitmeden yapilsin. baska bir
+    // thread'in zincirinde kalanlar varsa o zincir unmap edilmis hafizada yurunurdu
+    if (!deferred_release_heap(heap)) {
+        fprintf(stderr, "[heapster] heap_destroy: heap %p still has blocks queued by heapster_free_deferred "
+                "in other threads, call heapster_deferred_flush there first\n", (void *)heap);
+        return;
+    }
+
+    if (heap->is_shared) {
+        heapster_heap_detach_shared(heap);
+        return;
+    }
+
+    pthread_mutex_lock(&heap_registry_lock);
+
+    heapster_heap_t *prev = &heap_default;
+    while (prev->next && prev->next != heap) {
+        prev = prev->next;
+    }
+    if (!prev->next) {
+        pthread_mutex_unlock(&heap_registry_lock);
+        fprintf(stderr, "[heapster] heap_destroy: unknown heap %p\n", (void *)heap);
+        return;
+    }
+    prev->next = heap->next;
+
+    pthread_mutex_unlock(&heap_registry_lock);
+
+    // registry'den cikmis heap'i goren okuyucular da arena_release_all'daki epoch beklemesini gecemez
+    if (heap->file) {
+        persist_close(heap);
+    } else {
+        arena_release_all(heap);
+    }
+
+    pthread_mutex_destroy(&heap->list_lock);
+    munmap(heap, heap_struct_size());
+}
+
+void heapster_heap_status(heapster_heap_t *heap) {
+    epoch_enter();
+    heap_dump(heap ? heap : &heap_default);
+    epoch_exit();
+}
+
+/*
+hint heap'leri ilk kullanimda olusturulur. her biri kendi omur tipine gore ayarli:
+
+- SHORT_LIVED: kucuk (en fazla 1M) arenalar, first fit. hepsi kisa omurlu oldugu icin arena
+  cabuk tamamen bosalir ve free'deki destroy kontrolu onu geri verir
+- LONG_LIVED: buyuyen buyuk arenalar, best fit ile sik paketlenir. seyrek free'lerin actigi
+  delikler purge ile kernel'e doner
+- LARGE_STREAMING: arena adimi minimum, her buyuk istek kendi boyunda bir arena alir ve free
+  edildigi an munmap edilir. kucuk istekler de minimum boyutlu arenalarda kalir
+
+kilit yok (fork sirasinda tutulabilecek bir kilit olmasin diye): yarisan threadlerden CAS'i
+kaybeden kendi olusturdugu heap'i yok eder
+*/
+#define HEAP_HINT_SHORT     0
+#define HEAP_HINT_LONG      1
+#define HEAP_HINT_STREAMING 2
+#define HEAP_HINT_COUNT     3
+
+static _Atomic(heapster_heap_t *) hint_heaps[HEAP_HINT_COUNT];
+
+static const char *const hint_names[HEAP_HINT_COUNT] = {
+    "short-lived", "long-lived", "large-streaming"
+};
+
+static heapster_heap_t *hint_heap_create(int hint) {
+    heapster_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.mmap_threshold = 0;  // olusturulan heap'lerde zaten hep mmap
+    cfg.quick_max_size = heap_default.quick_max_size;
+    cfg.quick_consolidate_threshold = heap_default.quick_consolidate_threshold;
+    cfg.check_sample_rate = 1;
+
+    switch (hint) {
+        case HEAP_HINT_SHORT:
+            cfg.initial_arena_size = 256 * 1024;
+            cfg.max_arena_size = 1024 * 1024;
+            cfg.growth_factor = 2.0;
+            cfg.policy = HEAPSTER_FIRST_FIT;
+            break;
+        case HEAP_HINT_LONG:
+            cfg.initial_arena_size = 1024 * 1024;
+            cfg.max_arena_size = 64 * 1024 * 1024;
+            cfg.growth_factor = 2.0;
+            cfg.purge_decay_ms = 1000;
+            cfg.policy = HEAPSTER_BEST_FIT;
+            break;
+        default:
+            cfg.initial_arena_size = ARENA_MIN_SIZE;
+            cfg.max_arena_size = ARENA_MIN_SIZE;
+            cfg.growth_factor = 1.0;
+            cfg.quick_max_size = 0;
+            cfg.policy = HEAPSTER_FIRST_FIT;
+            break;
+    }
+
+    heapster_heap_t *heap = heapster_heap_create(&cfg);
+    if (!heap) {
+        return NULL;
+    }
+    strncpy(heap->name, hint_names[hint], sizeof(heap->name) - 1);
+
+    heapster_heap_t *expected = NULL;
+    if (!atomic_compare_exchange_strong(&hint_heaps[hint], &expected, heap)) {
+        heapster_heap_destroy(heap);
+        return expected;
+    }
+    return heap;
+}
+
+void *heapster_malloc_hint(size_t size, unsigned hints) {
+    int hint;
+    if (hints & HEAPSTER_HINT_LARGE_STREAMING) {
+        hint = HEAP_HINT_STREAMING;
+    } else if (hints & HEAPSTER_HINT_LONG_LIVED) {
+        hint = HEAP_HINT_LONG;
+    } else if (hints & HEAPSTER_HINT_SHORT_LIVED) {
+        hint = HEAP_HINT_SHORT;
+    } else {
+        return heapster_malloc(size);
+    }
+
+    // bounded latency modundaki thread'in allocation'lari hep rt havuzundan
+    if (size == 0 || rt_thread_enabled()) {
+        return heapster_malloc(size);
+    }
+
+    heapster_heap_t *heap = atomic_load_explicit(&hint_heaps[hint], memory_order_acquire);
+    if (!heap) {
+        heap = hint_heap_create(hint);
+    }
+    // hint heap'i olusturulamazsa varsayilan heap'ten verilir, hint sadece bir ipucu
+    return heapster_heap_malloc(heap ? heap : &heap_default, size);
+}
+
+// finalize icin: olusturulan heap'ler yok edilir, varsayilan heap'in arenalari geri verilir
+void heap_release_all(void) {
+    shm_detach_all();
+
+    // thread cache'lerindeki ve deferred free kuyrugundaki blocklar birazdan geri verilecek arenalarda
+    tcache_invalidate_all();
+    deferred_invalidate_all();
+
+    for (int i = 0; i < HEAP_HINT_COUNT; i++) {
+        atomic_store(&hint_heaps[i], NULL);
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&heap_registry_lock);
+        heapster_heap_t *heap = heap_default.next;
+        pthread_mutex_unlock(&heap_registry_lock);
+
+        if (!heap) {
+            break;
+        }
+        heapster_heap_destroy(heap);
+    }
+
+    arena_release_all(&heap_default);
+}
+
+/*
+fork.c icin. kilit sirasi: heap_registry_lock -> her heap icin list_lock -> o heap'in arena
+kilitleri. heap'ler arasinda ic ice kilit alan baska bir yol yok
+*/
+void heap_fork_prepare(void) {
+    pthread_mutex_lock(&heap_registry_lock);
+    for (heapster_heap_t *heap = &heap_default; heap; heap = heap->next) {
+        pthread_mutex_lock(&heap->list_lock);
+        arena_lock_all(heap);
+    }
+}
+
+void heap_fork_parent(void) {
+    for (heapster_heap_t *heap = &heap_default; heap; heap = heap->next) {
+        arena_unlock_all(heap);
+        pthread_mutex_unlock(&heap->list_lock);
+    }
+    pthread_mutex_unlock(&heap_registry_lock);
+}
+
+void heap_fork_child(void) {
+    for (heapster_heap_t *heap = &heap_default; heap; heap = heap->next) {
+        if (heap->file) {
+            persist_drop_after_fork(heap);
+        } else {
+            arena_reinit_after_fork(heap);
+        }
+        pthread_mutex_init(&heap->list_lock, NULL);
+    }
+    pthread_mutex_init(&heap_registry_lock, NULL);
+}
@@ -9,23 +9,31 @@
 main function definitions of public api
 */
 
-static heapster_policy_t current_policy = HEAPSTER_FIRST_FIT;
-static pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;
-static size_t default_arena_size = 128 * 1024; // 128 KB 
+void heapster_heap_set_policy(heapster_heap_t *heap, heapster_policy_t policy) {
+    if (!heap) {
+        heap = &heap_default;
+    }
+    atomic_store_explicit(&heap->policy, policy, memory_order_relaxed);
+}
+
+// her aramada arena kilidi altinda cagrilir, kilit yok. yeni policy bir sonraki aramada gorulur
+heapster_policy_t heap_get_policy(heapster_heap_t *heap) {
+    return atomic_load_explicit(&heap->policy, memory_order_relaxed);
+}
+
+heapster_policy_t heapster_heap_get_policy(heapster_heap_t *heap) {
+    return heap_get_policy(heap ? heap : &heap_default);
+}
 
 void heapster_set_policy(heapster_policy_t policy) {
-    pthread_mutex_lock(&policy_lock);
-    current_policy = policy;
-    pthread_mutex_unlock(&policy_lock);
+    heapster_heap_set_policy(&heap_default, policy);
 }
 
 heapster_policy_t heapster_get_policy(void) {
-    pthread_mutex_lock(&policy_lock);
-    heapster_policy_t policy = current_policy;
-    pthread_mutex_unlock(&policy_lock);
-    return policy;
+    return heap_get_policy(&heap_default);
 }
 
+// kisa yol: varsayilan config (+ HEAPSTER_CONF) uzerine arena boyutu ve policy, bir arena hemen olusturulur
 int heapster_init(size_t arena_size, heapster_policy_t policy) {
     size_t min_size = ARENA_MIN_SIZE;
 
@@ -34,169 +42,218 @@ int heapster_init(size_t arena_size, heapster_policy_t policy) {
         arena_size = min_size;
     }
 
-    default_arena_size = arena_size;
-    heapster_set_policy(policy);
+    heapster_config_t cfg;
+    heapster_config_default(&cfg);
+    cfg.arena_count = 1;
+    cfg.initial_arena_size = arena_size;
+    if (cfg.max_arena_size != 0 && cfg.max_arena_size < arena_size) {
+        cfg.max_arena_size = arena_size;
+    }
+    cfg.policy = policy;
 
-    arena_t *arena = arena_create(default_arena_size);
-    return arena ? 0 : -1;
+    return heapster_init_with_config(&cfg);
 }
 
 int heapster_finalize(void) {
-    pthread_mutex_lock(&arena_list_lock);
-
-    last_cleanup();
+    // olusturulan heap'ler yok edilir, varsayilan heap'in arenalari geri verilir. list_lock'lari
+    // kendisi alir ve okuyucularin cikmasini bekler
+    heap_release_all();
 
-    pthread_mutex_unlock(&arena_list_lock);
-
-    pthread_mutex_destroy(&policy_lock);
-    pthread_mutex_destroy(&arena_list_lock);
+    pthread_mutex_destroy(&heap_default.list_lock);
 
     return 0;
 }
 
 // requested size bu parametre iste kullanicinin block payloadinda bu kadar yer olmasu lazim minimum
 // heapster.c
+// yeni arenada yer aramak icin en fazla kac kez denenir (arena, biz ondan alamadan bosalip yok edilebilir)
+#define MALLOC_NEW_ARENA_RETRIES 4
+
+static void *heap_malloc(heapster_heap_t *heap, size_t size, int cache);
+
 void *heapster_malloc(size_t size) {
+    return heapster_heap_malloc(&heap_default, size);
+}
+
+// size class'i derleme aninda bilinen cagrilar (HEAPSTER_SIZE_CLASS), hizalama ve class hesabi yok
+void *heapster_malloc_class(int size_class) {
+    if ((unsigned)size_class >= HEAPSTER_SIZE_CLASSES) {
+        return NULL;
+    }
+
+    size_t size = ((size_t)size_class + 1) * ALIGNMENT;
+    void *ptr = tcache_malloc(size_class, size);
+    return ptr ? ptr : heap_malloc(&heap_default, size, 0);
+}
+
+void *heapster_heap_malloc(heapster_heap_t *heap, size_t size) {
+    return heap_malloc(heap, size, 1);
+}
+
+/*
+cache 0: thread cache'i atlanir. calloc arenanin malloc sayacini geri aldigi icin block'un
+gercekten arenadan gelmesi gerekiyor (cache isabetleri sayaca yazilmaz)
+*/
+static void *heap_malloc(heapster_heap_t *heap, size_t size, int cache) {
     if (size == 0) {
         return NULL;
     }
 
+    if (!heap) {
+        heap = &heap_default;
+    }
+
+    // varsayilan heap'in kucuk allocation'lari once thread cache'ine bakar (tcache.c)
+    if (cache && heap->is_default && size <= (size_t)HEAPSTER_SIZE_CLASSES * ALIGNMENT) {
+        void *cached = tcache_malloc((int)((size + ALIGNMENT - 1) / ALIGNMENT) - 1, size);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    // init cagrilmadiysa varsayilanlar ve HEAPSTER_CONF burada bir kez uygulanir
+    config_ensure_loaded();
+
+    // bounded latency modundaki thread sadece rt havuzunu kullanir, arena yolu syscall yapabilir
+    if (heap->is_default && rt_thread_enabled()) {
+        return rt_malloc(size);
+    }
+
+    // integrity check acikken bu allocation arm edilecek mi, canary icin arkasinda 8 byte yer birakilir
+    int armed = HEAPSTER_CHECK_OFF;
+    size_t check_extra = 0;
+    if (__builtin_expect(atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF, 0)) {
+        armed = check_sample();
+        check_extra = armed >= HEAPSTER_CHECK_CANARIES ? CHECK_CANARY_SIZE : 0;
+    }
+
     // İstenen payload boyutunu hizala
-    size_t aligned_payload_size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+    size_t aligned_payload_size = (size + check_extra + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
 
-    arena_t *arena = arena_get_list();
-    block_header_t *block = NULL;
-    arena_t *found_arena = NULL;
+    void *payload_ptr = NULL;
 
-    // 1. Mevcut Arenalarda Uygun Blok Bul
-    while (arena) {
-        // arena_find_free_block zaten ilgili arena kilidini kullanır ve açar.
-        block = arena_find_free_block(arena, aligned_payload_size);
-        if (block) {
-            found_arena = arena;
-            break;
+    // NUMA modunda sadece bu thread'in node'undaki (ya da baglanmamis) arenalara bakilir
+    int numa_node = numa_mode_enabled() ? numa_current_node() : -1;
+
+    // arena listesi global kilit olmadan geziliyor, okuma bolumu icinde gorulen hicbir arena unmap edilmez
+    epoch_enter();
+
+    /*
+    1. Mevcut Arenalardan En Dolu Olani Sec
+    liste sirasiyla ilk sigan arenayi almak allocationlari tum arenalara yayiyordu ve hicbiri
+    bosalip yok edilemiyordu. ipuclarina (kilitsiz) bakip sigabilecek en dolu arena secilir,
+    neredeyse bos arenalar (ARENA_DRAIN_PERMILLE alti) baska yer varken atlanir ki bosalsinlar.
+    dolulugu yakin arenalardan az parcali olan tercih edilir
+    */
+    arena_t *best = NULL;
+    unsigned best_occupancy = 0;
+    unsigned best_frag = 0;
+    arena_t *fallback = NULL;
+    unsigned fallback_occupancy = 0;
+
+    for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+        if (numa_node >= 0 && arena->numa_node >= 0 && arena->numa_node != numa_node) {
+            continue;
+        }
+        if (atomic_load_explicit(&arena->largest_hint, memory_order_relaxed) < aligned_payload_size) {
+            continue;
+        }
+
+        unsigned occupancy = arena_occupancy_permille(arena);
+        int draining = occupancy < ARENA_DRAIN_PERMILLE && !arena->is_reserved;
+
+        // hepsi bosaltiliyorsa en azindan en dolusu kullanilir, digerleri bosalmaya devam eder.
+        // baska threadlerin free'leri kuyrukta bekliyorsa burada bosaltilir, bosaldiysa yok edilir
+        if (draining) {
+            if (arena_reap_remote_frees(arena)) {
+                continue;
+            }
+            if (!fallback || occupancy > fallback_occupancy) {
+                fallback = arena;
+                fallback_occupancy = occupancy;
+            }
+            continue;
+        }
+
+        unsigned frag = atomic_load_explicit(&arena->frag_hint, memory_order_relaxed);
+        if (!best ||
+            occupancy > best_occupancy + ARENA_OCCUPANCY_TIE_PERMILLE ||
+            (occupancy + ARENA_OCCUPANCY_TIE_PERMILLE >= best_occupancy && frag < best_frag)) {
+            best = arena;
+            best_occupancy = occupancy;
+            best_frag = frag;
         }
-        arena = arena->next;
+    }
+
+    if (!best) {
+        best = fallback;
+    }
+
+    if (best) {
+        // arena_alloc kendi kilidini alir, arama + bolme + stat tek seferde
+        payload_ptr = arena_alloc(best, aligned_payload_size, size);
+    }
+
+    // ipucu bayatsa ya da sadece bosaltilan arenalarda yer varsa: eski sirali tarama, yeni arenadan iyidir
+    for (arena_t *arena = arena_get_list(heap); arena && !payload_ptr; arena = arena->next) {
+        if (arena == best) {
+            continue;
+        }
+        if (numa_node >= 0 && arena->numa_node >= 0 && arena->numa_node != numa_node) {
+            continue;
+        }
+
+        payload_ptr = arena_alloc(arena, aligned_payload_size, size);
     }
 
     // 2. Blok Bulunamadıysa Yeni Arena Oluştur
-    if (!block) {
-        // Yeni arena için gereken tahmini boyutu hesapla
-        size_t arena_size = aligned_payload_size + BLOCK_HEADER_SIZE + ARENA_HEADER_SIZE;
+    // sabit boyutlu heap'ler (dosya) buyumez
+    int grew = !payload_ptr && !heap->fixed_size;
+    for (int attempt = 0; !payload_ptr && !heap->fixed_size && attempt < MALLOC_NEW_ARENA_RETRIES; attempt++) {
+        // Yeni arena için gereken boyut, en az config'deki buyume adimi kadar
+        size_t arena_size = config_next_arena_size(heap, aligned_payload_size + BLOCK_HEADER_SIZE + ARENA_HEADER_SIZE);
 
         if (arena_size < ARENA_MIN_SIZE) {
             arena_size = ARENA_MIN_SIZE;
         }
 
-        arena_t *new_arena = arena_create(arena_size);
+        arena_t *new_arena = arena_create(heap, arena_size);
         if (!new_arena) {
-            return NULL; 
+            break;
         }
 
-        found_arena = new_arena;
-        
-        // Yeni arenada bloğu tekrar bul
-        block = arena_find_free_block(new_arena, aligned_payload_size);
-    }
-    
-    // Hala blok yoksa (hata durumu)
-    if (!block) {
-        fprintf(stderr, "[fatal error] there has to be at least one block here.\n");
-        return NULL;
+        // yeni arena listeye girdigi an baska threadler de ondan alabilir, o yuzden NULL donebilir
+        payload_ptr = arena_alloc(new_arena, aligned_payload_size, size);
     }
 
-    arena = found_arena;
-    
-    // Kilit altına al ve İstatistik Güncellemelerini yap
-    pthread_mutex_lock(&arena->lock);
-    
-    void *payload_ptr = NULL;
-    block_header_t *allocated_block = NULL;
-
-    size_t old_block_size = block->size; 
-    size_t old_largest_free = arena->stats.largest_free_block;
-    
-    arena->stats.malloc_calls++;
+    epoch_exit();
 
-    if (block->size >= aligned_payload_size + BLOCK_MIN_SIZE) {  // block_min_size split ten sonraki block icin yer varmi
-        // Split işlemi deneniyor
-        block_header_t *splitted_first_part = block_split(arena, block, aligned_payload_size);
-        
-        // Split başarıyla sonuçlandıysa
-        if (splitted_first_part) { 
-            allocated_block = splitted_first_part;
-            
-            // Tahsis edilen bloğu ayarla
-            allocated_block->requested_size = size;
-            payload_ptr = block_to_payload(allocated_block);
-            
-            // ** İSTATİSTİK GÜNCELLEME (SPLIT) **
-            size_t allocated_size = allocated_block->size;
-            
-            arena->stats.used_bytes += allocated_size; 
-            arena->stats.free_bytes -= allocated_size; 
-            
-            arena->stats.wasted_bytes += (allocated_size - size);
-            arena->stats.allocated_block_count++;
-            // free_block_count, block_split içinde zaten artırıldı.
-            
-            // Largest Free Block Güncellemesi (Split yeni bir serbest blok oluşturduysa)
-            // block_split, kalan serbest bloğu free list'e ekledi ve eğer boyutu büyükse
-            // largest_free_block'u güncellemesi GEREKİR. 
-            // Eğer block_split bu güncellemeyi yapmıyorsa, burada manuel kontrol eklenebilir.
-            // Şimdilik, block_split'in sadece free list'i yönettiğini varsayalım.
-            // Yeniden hesaplama, 5. adımda zaten yapılıyor.
+    // yok edilmis arenalar varsa okuma bolumu disindayken geri verilir
+    arena_collect_retired(heap);
 
-        } 
+    // yeni arena soft limiti gectiyse ya da hard limite takildiysa callback + trim (budget.c)
+    if (grew) {
+        budget_handle_pressure(heap);
+    }
 
-    } else {
-        // 4. Tam Kullanım Durumu (Split Yok) - KRİTİK DÜZELTME BURADA
-        
-        // Bloğu serbest listeden çıkar (Tamamen kullanıldığı için)
-        block_remove_from_free_list(arena, block);
-
-        // Bloğu tahsis edilmiş olarak işaretle
-        block->free = 0;
-        block->requested_size = size;    
-        block->magic = CTRL_CHR; 
-        payload_ptr = block_to_payload(block);
-        allocated_block = block; 
-        
-        // ** İSTATİSTİK GÜNCELLEME (TAM KULLANIM) - DÜZELTİLDİ **
-        
-        // used_bytes: Gerçekten tahsis edilen payload'ın tamamını ekle (Örn: 288)
-        arena->stats.used_bytes += old_block_size; 
-        
-        // free_bytes: Serbest listeden çıkan payload'ın tamamını çıkar (Örn: 288)
-        arena->stats.free_bytes -= old_block_size; 
-        
-        // wasted_bytes: İstenen (40) ile tahsis edilen (288) arasındaki farkı ekle (Örn: 248)
-        arena->stats.wasted_bytes += (old_block_size - size);
-        
-        arena->stats.allocated_block_count++;
-        arena->stats.free_block_count--; // Serbest blok tamamen kullanıldığı için azalır.
+    if (armed && payload_ptr) {
+        check_arm(payload_to_block(payload_ptr), armed);
     }
-    
-    // 5. Largest Free Block'u Yeniden Hesapla (Split/Tam kullanım sonrası)
-    // Eğer kullanılan blok (old_block_size) önceki en büyük bloksa, yeni en büyük bloğu bul.
-    if (old_largest_free == old_block_size) {
-        arena->stats.largest_free_block = 0;
-        block_header_t *current = arena->free_list_head;
-        while (current) {
-            if (current->size > arena->stats.largest_free_block) {
-                arena->stats.largest_free_block = current->size;
-            }
-            current = current->next;
-        }
+
+    // sampling profiler: thread-local geri sayac sifirin altina inmedikce baska maliyet yok
+    if (__builtin_expect((profile_countdown -= (int64_t)size) < 0, 0) && payload_ptr) {
+        profile_sample(payload_ptr);
     }
 
-    pthread_mutex_unlock(&arena->lock);
-    
     return payload_ptr;
 }
 
 // n member and each member has the size of size
 void *heapster_calloc(size_t nmemb, size_t size) {
+    return heapster_heap_calloc(&heap_default, nmemb, size);
+}
+
+void *heapster_heap_calloc(heapster_heap_t *heap, size_t nmemb, size_t size) {
 
     // 1. Taşma (Overflow) Kontrolü
     size_t total = nmemb * size;
@@ -207,43 +264,47 @@ void *heapster_calloc(size_t nmemb, size_t size) {
     }
 
     // 2. Bellek Tahsisi
-    void *ptr = heapster_malloc(total); 
+    void *ptr = heap_malloc(heap ? heap : &heap_default, total, 0);
     if (!ptr) {
         return NULL;
     }
 
+    // rt havuzundan geldiyse arena sayaclari yok, sadece sifirla
+    if (rt_owns(ptr)) {
+        memops_zero(ptr, total);
+        return ptr;
+    }
+
     // 3. İstatistik Güncelleme (malloc -> calloc)
     block_header_t *block = payload_to_block(ptr);
-    arena_t *arena = arena_get_list(); 
-    
+
     // İlgili arenayı bul
-    while (arena && arena->id != block->arena_id) {
-        arena = arena->next;
-    }
+    epoch_enter();
+    arena_t *arena = arena_find_by_id(block->arena_id);
     
     if (arena) {
-        pthread_mutex_lock(&arena->lock); 
-        
         // heapster_malloc içinde sayılan çağrıyı (malloc_calls) geri al,
-        // yerine calloc_calls'u say.
-        if (arena->stats.malloc_calls > 0) {
-            arena->stats.malloc_calls--;
-        }
-        arena->stats.calloc_calls++;
-        
-        pthread_mutex_unlock(&arena->lock);
+        // yerine calloc_calls'u say. sayaclar shard'li atomic, lock gerekmez
+        arena_counter_add(arena, ARENA_COUNTER_MALLOC, -1);
+        arena_counter_add(arena, ARENA_COUNTER_CALLOC, 1);
     }
+    epoch_exit();
     
-    // 4. Belleği Sıfırlama
-    memset(ptr, 0, total); 
+    // 4. Belleği Sıfırlama (buyukse cache'i kirletmeden, memops.c)
+    memops_zero(ptr, total);
     return ptr;
 }
 
 void *heapster_realloc(void *ptr, size_t size) {
+    return heapster_heap_realloc(&heap_default, ptr, size);
+}
+
+// ptr NULL degilse yeni block ptr'nin heap'inden alinir, heap sadece ptr NULL iken kullanilir
+void *heapster_heap_realloc(heapster_heap_t *heap, void *ptr, size_t size) {
 
     // 1. Edge Case: ptr NULL ise, malloc çağrısı yapılır.
     if (!ptr) {
-        return heapster_malloc(size); 
+        return heapster_heap_malloc(heap, size); 
     }
     
     // 2. Edge Case: size 0 ise, free çağrısı yapılır.
@@ -252,31 +313,38 @@ void *heapster_realloc(void *ptr, size_t size) {
         return NULL;
     }
 
+    if (rt_owns(ptr)) {
+        return rt_realloc(ptr, size);
+    }
+
     block_header_t *block = payload_to_block(ptr);
 
+    // double free / bozuk header / tasma bulunduysa block'a dokunulmaz
+    if (__builtin_expect(atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF ||
+                         block->check != 0, 0) &&
+        check_before_free(block, "realloc") != 0) {
+        return NULL;
+    }
+
     // Blok doğrulama kontrolü
     if (block_validate(block) <= 0) {
         fprintf(stderr, "[heapster] invalid realloc %p\n", ptr);
         return NULL;
     }
 
-    // İlgili arenayı bul
-    arena_t *arena = arena_get_list();
-    while (arena && arena->id != block->arena_id) {
-        arena = arena->next;
-    }
+    // İlgili arenayı bul, arena pointer'i kullanildigi surece okuma bolumunda kalinir
+    epoch_enter();
+    arena_t *arena = arena_find_by_id(block->arena_id);
 
     // Arena bulunamazsa (hata durumu)
     if (!arena) {
+        epoch_exit();
         fprintf(stderr, "[heapster] realloc: block %p arena not found\n", ptr);
         return NULL;
     }
 
-    // ** İSTATİSTİK: ÇAĞRI SAYISI **
-    pthread_mutex_lock(&arena->lock); 
-    arena->stats.realloc_calls++;
-    pthread_mutex_unlock(&arena->lock);
-    // ** ÇAĞRI SAYISI GÜNCEL **
+    // ** İSTATİSTİK: ÇAĞRI SAYISI ** (shard'li atomic, lock gerekmez)
+    arena_counter_add(arena, ARENA_COUNTER_REALLOC, 1);
     
     size_t aligned_payload_size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
     
@@ -285,7 +353,7 @@ void *heapster_realloc(void *ptr, size_t size) {
     if (block->size >= aligned_payload_size) {
         
         // Split/Daraltma İçin Kilit Al
-        pthread_mutex_lock(&arena->lock);
+        arena_lock(arena);
         
         // Eğer küçültme, minimum blok boyutunun üzerinde bir serbest parça bırakıyorsa:
         if (block->size >= aligned_payload_size + BLOCK_MIN_SIZE) {
@@ -318,34 +386,58 @@ void *heapster_realloc(void *ptr, size_t size) {
         } else {
             // Daralma var ama kalan kısım çok küçük, split yapılamaz (in-place daraltma)
             // Sadece wasted_bytes güncellenmeli. block->size aynı kalır.
-            pthread_mutex_lock(&arena->lock); // Zaten yukarıda lock var, bu kısım gereksiz.
-            
+            // kilit yukarida zaten alindi, tekrar almak kendi kendini kilitliyordu
             size_t old_requested_size = block->requested_size;
             arena->stats.wasted_bytes -= (block->size - old_requested_size); // eski israfı çıkar
             arena->stats.wasted_bytes += (block->size - size);                  // yeni israfı ekle
             
-            // pthread_mutex_unlock(&arena->lock); // Gereksiz.
+            // arena_unlock(arena); // Gereksiz.
         }
 
         // requested_size'ı güncelle ve pointer'ı döndür
+        // checksum requested_size'i da kapsadigi icin block ayni seviyede yeniden arm edilir
+        int armed = check_armed_level(block);
         block->requested_size = size;
-        pthread_mutex_unlock(&arena->lock);
+        if (armed) {
+            check_arm(block, armed);
+        }
+        arena_unlock(arena);
+        epoch_exit();
         return ptr;
     }
 
+    // block baska heap'e tasinmasin, heap pointer'i arena'dan okuma bolumu bitmeden alinir
+    heapster_heap_t *owner_heap = arena->heap;
+
+    // sayfalar mremap ile tasinabilir mi (hugetlbfs sayfalari kismen tasinamaz, dosya sayfalari
+    // tasinirsa yazilanlar dosyaya gitmez)
+    int remap = arena->is_mmap && arena->is_huge != 2 && !owner_heap->fixed_size;
+
+    epoch_exit();
+
     // 4. Yeni Tahsis ve Kopyalama (Boyut Yetersiz)
     
-    void *new_ptr = heapster_malloc(size); // Malloc istatistikleri günceller
+    void *new_ptr = heapster_heap_malloc(owner_heap, size); // Malloc istatistikleri günceller
     if (!new_ptr) {
         return NULL;
     }
 
-    // Kopyalanacak boyutu belirle
-    size_t old_used = block->requested_size; 
+    // Kopyalanacak boyutu belirle. requested_size degil block->size: thread cache'inden (tcache.c)
+    // tekrar verilen block'ta requested_size ilk allocation'in boyutu, kullanici daha fazlasini yazmis olabilir
+    size_t old_used = block->size;
     size_t copy_n = old_used < size ? old_used : size;
 
-    // Veriyi kopyala
-    memcpy(new_ptr, ptr, copy_n);
+    // Veriyi kopyala: buyukse streaming store ile, iki block da mmap arenadaysa sayfa tasiyarak
+    if (remap && copy_n > 0) {
+        remap = 0;
+        if (!rt_owns(new_ptr)) {
+            epoch_enter();
+            arena_t *new_arena = arena_find_by_id(payload_to_block(new_ptr)->arena_id);
+            remap = new_arena && new_arena->is_mmap && new_arena->is_huge != 2 && !new_arena->heap->fixed_size;
+            epoch_exit();
+        }
+    }
+    memops_move(new_ptr, ptr, copy_n, remap);
 
     // Eski bloğu serbest bırak
     heapster_free(ptr); // Free istatistikleri günceller
@@ -361,10 +453,39 @@ sbrk ile alinmis arena ama en sondaki ise sil tamamen
 sbrk ile alinmis ama ortadakilerden biri o zaman silme sadece reset
 */
 
+static void heap_free(heapster_heap_t *expected, void *ptr, int cache);
+
 void heapster_free(void *ptr) {
+    heap_free(NULL, ptr, 1);
+}
+
+void heapster_heap_free(heapster_heap_t *heap, void *ptr) {
+    heap_free(heap ? heap : &heap_default, ptr, 1);
+}
+
+// thread cache'inden (tcache.c) arenaya geri veriliyor, tekrar cache'e girmesin
+void heap_free_direct(void *ptr) {
+    heap_free(NULL, ptr, 0);
+}
+
+// expected NULL degilse ptr o heap'in degilse free edilmez
+static void heap_free(heapster_heap_t *expected, void *ptr, int cache) {
     if (!ptr) return;
 
+    // rt havuzundaki pointer hangi thread'den gelirse gelsin havuza doner
+    if (rt_owns(ptr)) {
+        rt_free(ptr);
+        return;
+    }
+
     block_header_t *block = payload_to_block(ptr);
+
+    // 0. integrity check (check.c): double free, bozuk header ya da tasmada block leak edilir
+    if (__builtin_expect(atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF ||
+                         block->check != 0, 0) &&
+        check_before_free(block, "free") != 0) {
+        return;
+    }
     
     // 1. Blok Doğrulama
     if (block_validate(block) <= 0) {
@@ -372,65 +493,75 @@ void heapster_free(void *ptr) {
         return;
     }
 
-    // 2. Arena'yı Bulma
-    arena_t *arena = arena_get_list();
-    while (arena) {
-        if (arena->id == block->arena_id) {
-            
-            pthread_mutex_lock(&arena->lock);
+    // profiler acikken ornek alinmis pointer'lar canli listesinden duser
+    if (__builtin_expect(atomic_load_explicit(&profile_live_samples, memory_order_relaxed) != 0, 0)) {
+        profile_forget(ptr);
+    }
 
-            // *********************************************************
-            // 3. İSTATİSTİK GÜNCELLEMELERİ (FREE)
-            // *********************************************************
-            size_t freed_payload_size = block->size;
-            
-            arena->stats.free_calls++;
-            arena->stats.used_bytes -= freed_payload_size;
-            arena->stats.allocated_block_count--;
-            
-            // Serbest kalan payload alanını free_bytes'a ekle
-            arena->stats.free_bytes += freed_payload_size; 
-            
-            // İç Fragmentasyon İadesi: Daha önce atanan israfı geri al
-            arena->stats.wasted_bytes -= (freed_payload_size - block->requested_size);
-            
-            // Yeni bir serbest blok oluşacağı için sayacı artır (birleşme sonradan azaltacak)
-            arena->stats.free_block_count++;
-            // *********************************************************
+    // 2. Arena'yı Bulma (kilitsiz gezinti, okuma bolumu icinde)
+    epoch_enter();
 
-            block->free = 1;
-            block->requested_size = 0;
+    arena_t *arena = arena_find_by_id(block->arena_id);
+    if (!arena) {
+        epoch_exit();
+        fprintf(stderr, "[heapster] free: block %p not found in any arena\n", ptr);
+        return;
+    }
 
-            // 4. Birleştirme (Coalescing)
-            block_header_t *coalesced_block = block_coalesce(arena, block);
-            
-            // Birleşme sonrası en büyük serbest bloğu güncelle
-            if (coalesced_block && coalesced_block->size > arena->stats.largest_free_block) {
-                arena->stats.largest_free_block = coalesced_block->size;
-            }
-            
-            // 5. Arena Yok Etme Kontrolü
-            bool destroy = false;
-            // Tüm bellek tek bir serbest bloksa ve tahsis edilen bellek kalmadıysa (sadece mmap için daha önemlidir)
-            if (arena->block_count == 1 &&
-                arena->free_list_head == coalesced_block &&
-                !coalesced_block->phys_prev &&
-                !coalesced_block->phys_next &&
-                coalesced_block->size + BLOCK_HEADER_SIZE ==
-                   arena->size - ARENA_HEADER_SIZE) {
-                destroy = true;
-            }
+    if (expected && arena->heap != expected) {
+        epoch_exit();
+        fprintf(stderr, "[heapster] free: block %p does not belong to heap %p\n", ptr, (void *)expected);
+        return;
+    }
 
-            pthread_mutex_unlock(&arena->lock);
+    heapster_heap_t *heap = arena->heap;
 
-            if (destroy) {
-                arena_destroy(arena);  
-            }
-            return;
+    // varsayilan heap'in kucuk blocklari thread cache'inde bekler, kilit ve coalesce yok
+    if (cache && heap->is_default && tcache_free(block)) {
+        epoch_exit();
+        return;
+    }
+
+    // 3. Owner olmayan thread kilide hic dokunmaz, block remote queue'ya gider. shared arenada
+    // owner baska bir process'te olabilir (ve cikmis olabilir), orada hep kilitle free edilir.
+    // owner thread bittiyse de kuyrugu drain edecek kimse yok, kilitle free edilir
+    if (!arena->is_shared && !atomic_load_explicit(&arena->owner_exited, memory_order_relaxed) &&
+        !pthread_equal(arena->owner, pthread_self())) {
+        int reap = arena_remote_free(arena, block);
+        if (reap < 0) {
+            fprintf(stderr, "[heapster] free: double free of %p (already freed by another thread)\n", ptr);
+        }
+
+        // arena neredeyse bosaldi, malloc ondan kacinacagi icin kuyruk burada drain edilir
+        int destroyed = reap > 0 && arena_reap_remote_frees(arena);
+        epoch_exit();
+        if (destroyed) {
+            arena_collect_retired(heap);
         }
-        arena = arena->next;
+        return;
+    }
+
+    arena_lock(arena);
+
+    // kilit zaten elimizde, bekleyen remote free'leri de ayni seferde bitir
+    arena_drain_remote_frees(arena);
+
+    // 4. Istatistik + coalescing, arena tamamen bosaldiysa destroy
+    int destroy = arena_free_block(arena, block);
+
+    // purge_decay_ms acikken bos sayfalar zaman zaman kernel'e geri verilir
+    if (!destroy) {
+        arena_maybe_purge(arena);
+    }
+
+    arena_unlock(arena);
+
+    // destroy arenayi sadece listeden cikarir, geri verme bizim okuma bolumumuz bitince olur
+    if (destroy) {
+        arena_destroy(arena);  
     }
 
-    fprintf(stderr, "[heapster] free: block %p not found in any arena\n", ptr);
+    epoch_exit();
+    arena_collect_retired(heap);
 }
 
@@ -7,18 +7,43 @@
 #include <pthread.h>
 #include <stdalign.h>
 #include <stdio.h>
+#include <stdatomic.h>
 
+#include "heapster.h"
 #include "stats.h"
+#include "lock.h"
 
 #define CTRL_CHR   0xC0FFEE     // kahvesiz kod olmaz kral.
 #define ALIGNMENT alignof(max_align_t)  
 // bir sistemde uyulabilecek max alignment miktaridir bende degeri 8 bunu ayarlanabilir yapmayi denedim ama zor oldu ondan sildim
 
-extern pthread_mutex_t arena_list_lock;
+// false sharing'i onlemek icin hizalanan birim. x86_64 ve cogu arm64 icin 64 byte
+#define HEAPSTER_CACHE_LINE 64
+
+// heapster_check_level_t, kapaliyken (0) malloc/free'de tek branch (check.c)
+extern _Atomic int check_level;
+
+// sampling profiler (profile.c): thread basina byte geri sayaci ve canli ornek sayisi
+extern _Thread_local int64_t profile_countdown;
+extern _Atomic size_t profile_live_samples;
+
+/*
+deferred coalescing (glibc fastbin benzeri). acik olan arenada kucuk blocklar free edilince
+komsulari ile birlestirilmez, boyutuna gore quick bin'e atilir ve ayni boyuttaki bir sonraki
+malloc onu direk geri alir. birlestirme toplu halde arena_consolidate ile yapilir
+*/
+#define BLOCK_QUICK 2   // block->free icin ucuncu durum: free ama quick bin'de park halinde, free list'te degil
+#define BLOCK_TCACHE 3  // free ama bir thread'in cache'inde (tcache.c), arena icin hala allocated
+#define BLOCK_DEFERRED 4  // heapster_free_deferred kuyrugunda (deferred.c), arena icin hala allocated
+#define BLOCK_REMOTE 5  // baska bir thread free etti, arenanin remote stack'inde drain'i bekliyor
+#define QUICK_BIN_COUNT 16  // bin i -> payload size (i + 1) * ALIGNMENT
+#define QUICK_MAX_SIZE (QUICK_BIN_COUNT * ALIGNMENT)
+#define QUICK_CONSOLIDATE_THRESHOLD 256  // bu kadar block park edilince toplu birlestirme yapilir
 
 typedef struct block_header {
     size_t size;  // size of the block except header
-    int free;     // allocation flag: 1 = free (available in free list), 0 = allocated (owned by user)
+    int free;     // allocation flag: 1 = free (available in free list), 0 = allocated (owned by user), BLOCK_QUICK = parked in a quick bin, BLOCK_TCACHE = in a thread cache, BLOCK_DEFERRED = queued by heapster_free_deferred, BLOCK_REMOTE = on the arena's remote free stack
+    uint32_t check;  // integrity check (check.c): 0 = not armed, otherwise header checksum, top bit = trailing canary written
 
     size_t requested_size; // what did user want bundan kast edilen block diyelim 4096 byte ama kullanici 100 istedi o zaman 100
 
@@ -41,18 +66,150 @@ typedef struct block_header {
 
 } block_header_t;
 
+/*
+buyuk free blocklar icin size sirali red-black tree dugumu. ayri bir yer ayirmamak icin free
+blockun payload'inin basina yazilir (block free iken payload zaten kimsenin degil). anahtar
+(size, adres) ciftidir, ayni boyuttakiler adrese gore siralanir. payload'i bu dugumu
+tasiyamayacak kadar kucuk (tiny) blocklar sadece free list'te durur
+*/
+typedef struct free_tree_node {
+    struct block_header *left;
+    struct block_header *right;
+    struct block_header *parent;
+    int red;
+} free_tree_node_t;
+
+/*
+cagri sayaclari arena lock'u altinda tutulmuyor, her CPU (cpu % ARENA_COUNTER_SHARDS) kendi
+cache line'indaki shard'a relaxed atomic ekleme yapar. okunurken tum shardlar toplanir
+*/
+#define ARENA_COUNTER_SHARDS 8
+
+typedef enum {
+    ARENA_COUNTER_MALLOC  = 0,
+    ARENA_COUNTER_FREE    = 1,
+    ARENA_COUNTER_REALLOC = 2,
+    ARENA_COUNTER_CALLOC  = 3,
+    ARENA_COUNTER_COUNT
+} arena_counter_t;
+
+typedef struct {
+    alignas(HEAPSTER_CACHE_LINE) _Atomic uint64_t value[ARENA_COUNTER_COUNT];
+} arena_counter_shard_t;
+
+/*
+heap (heapster_heap_t): kendi arena listesi, ayarlari ve statlari olan bagimsiz bir heap.
+eskiden arena listesi ve ayarlar arena.c'de global static'ti, tum process tek heap'i
+paylasiyordu. heapster_malloc & co. varsayilan heap'i (heap_default) kullanir,
+heapster_heap_create ile olusturulanlar heap.c'deki registry'de durur. arenalar heap'lerine
+arena->heap ile baglidir, free edilen pointer hangi heap'ten geldiyse oraya doner
+*/
+struct heapster_heap {
+    // okuyucular kilitsiz gezer (epoch_enter/epoch_exit arasinda), yazicilar list_lock tutar
+    _Atomic(struct arena *) arena_list_head;
+    pthread_mutex_t list_lock;
+
+    // listeden cikarilmis ama okuyucular hala gorebilecegi icin henuz geri verilmemis arenalar (list_lock ile korunur)
+    struct arena *retired_list_head;
+    _Atomic int retired_pending;
+
+    // ayarlar, heapster_config_t'den (varsayilan heap icin setter'lardan da) gelir
+    _Atomic heapster_policy_t policy;      // kilitsiz okunur (heap_get_policy)
+    size_t mmap_threshold;                 // bu boyuttan buyuk arenalar mmap, kucukler sbrk (sadece varsayilan heap)
+    int deferred_coalesce_default;         // yeni arenalarin deferred coalescing ayari
+    size_t quick_max_size;                 // quick bin'e park edilecek en buyuk payload
+    size_t quick_consolidate_threshold;    // toplu birlestirme esigi
+    unsigned purge_decay_ms;               // 0 degilse free sonrasi arena en fazla bu kadar ms'de bir purge edilir
+
+    // arena buyumesi (config.c): sonraki arena en az next_arena_step kadar
+    _Atomic size_t next_arena_step;
+    size_t max_arena_size;
+    double growth_factor;
+
+    // 1 = heap_default. olusturulan heap'lerin arenalari hep mmap'tir ki destroy hepsini geri verebilsin
+    int is_default;
+
+    // heapster_status'ta heap adresinin yaninda yazilir, bos olabilir. pointer degil ki
+    // shared memory'deki heap'in adi her process'te okunabilsin
+    char name[16];
+
+    // 1 = yeni arena eklenmez, dolunca malloc NULL doner (dosya heap'leri, persist.c)
+    int fixed_size;
+
+    // dosya heap'lerinde dosyanin map edildigi yer (basinda heap_file_header), digerlerinde NULL
+    struct heap_file_header *file;
+    size_t file_size;
+    int file_fd;  // flock'u tutar, ayni dosya iki kez acilamaz
+
+    // 1 = struct'in kendisi shared memory'de (shm.c), registry'de degil
+    int is_shared;
+
+    // handle heap'lerinde (handle.c) tek arenanin basi, handle'lar buradan ALIGNMENT birimli offset
+    char *handle_base;
+
+    // heapster_free_deferred kuyruklarindaki (deferred.c) bu heap'e ait block sayisi
+    _Atomic size_t deferred_blocks;
+
+    // bellek butcesi (budget.c): arenalarin toplam boyutu ve limitler (0 = sinir yok)
+    _Atomic size_t mapped_bytes;
+    _Atomic size_t soft_limit;
+    _Atomic size_t hard_limit;
+    _Atomic int pressure_pending;  // HEAPSTER_PRESSURE_*, bir sonraki buyuyen malloc isler
+    _Atomic int hard_latched;      // hard limit callback'i bu sefer icin cagrildi
+    heapster_pressure_fn pressure_fn;  // list_lock ile korunur
+    void *pressure_arg;
+    _Atomic uint64_t budget_pressure_events;
+    _Atomic uint64_t budget_hard_failures;
+
+    // heap registry (heap.c), okuyucular kilitsiz gezer
+    _Atomic(struct heapster_heap *) next;
+};
+
+extern heapster_heap_t heap_default;
+
+/*
+HEAPSTER_ADAPTIVE heap'lerinde arena basina policy secimi (policy.c). aramalar ADAPTIVE_WINDOW'luk
+pencerelerde olculur, her pencere sonunda o an kullanilan somut policy'nin maliyeti guncellenir
+ve siradaki policy secilir. arena kilidi altinda
+*/
+#define POLICY_CONCRETE_COUNT 4  // FIRST, NEXT, BEST, WORST
+
+typedef struct {
+    int current;                               // su an aramalari yapan somut policy
+    uint32_t window_searches;                  // bu penceredeki arama sayisi
+    uint32_t window_misses;                    // arenada yer varken bulunamayan aramalar
+    uint64_t window_steps;                     // bu penceredeki aramalarda bakilan block/node
+    uint64_t window_free_steps_start;          // pencere basinda stats.free_list_steps
+    double window_frag_start;                  // pencere basindaki fragmentation_ratio
+    double cost[POLICY_CONCRETE_COUNT];        // policy basina yumusatilmis maliyet, < 0 = denenmedi
+    uint32_t measured_at[POLICY_CONCRETE_COUNT]; // maliyetin en son olculdugu pencere
+    uint32_t windows;                          // tamamlanan pencere sayisi
+} policy_adaptive_t;
+
+/*
+arena header'i cache line'lara bolunmus durumda. eskiden lock, free list, statlar ve next
+ayni satirlardaydi ve her malloc_calls++ arena listesini gezen diger threadlerin okudugu
+satiri kirletiyordu (false sharing). simdi:
+
+1. satir(lar): sadece olusturulurken yazilan, herkesin kilitsiz okudugu alanlar (next, id, ...)
+2. satir: remote free stack'in basi, baska threadlerin CAS yaptigi tek alan
+   sonra: doluluk ipuclari, sahibi yazar ve arena secerken herkes okur
+3. satir(lar): lock ve lock altinda degisen free list / tree / quick bin alanlari
+4. satir(lar): lock altinda guncellenen byte statlari
+5. sonrasi: cagri sayaclari, her CPU grubu icin ayri satirda atomic shard (stats.c)
+*/
 typedef struct arena {
-    // arena id si
-    uint64_t id;
+    /* ---- read-mostly ---- */
 
-    // for thread safe alocation from pthread.h kullanip kullanmayacagim supheli
-    pthread_mutex_t lock;       
+    // arena id si
+    alignas(HEAPSTER_CACHE_LINE) uint64_t id;
 
-    // free blocklari tutan listin basi
-    struct block_header *free_list_head;  
+    // arenanin ait oldugu heap, ayarlar ve liste buradan
+    struct heapster_heap *heap;
 
-    // policy olarak find_next_fir icin cursor pointer
-    struct block_header *next_fit_cursor;
+    // global stati ayarlayabilmek icin tum arenalari gezmek lazim
+    // okuyucular kilitsiz gezer, sadece heap->list_lock tutan yazici degistirir (epoch.c)
+    _Atomic(struct arena *) next;
 
     // arena ici free olup olmayan tum blocklar
     void *start;
@@ -60,19 +217,92 @@ typedef struct arena {
 
     // includes headers and payloads direk arenanin tum size i 
     size_t size; 
-    int64_t block_count;
 
     size_t requested_size;
 
+    // nasil allocate edildigi mmap mi sbrk mi mmap ise 1 sbrk ise 0
+    int is_mmap;
+
+    // huge page destegi: 0 = normal sayfalar, 1 = THP icin madvise edildi, 2 = MAP_HUGETLB (hugetlbfs)
+    // huge arenalar HUGE_PAGE_SIZE'a hizali baslar ve size'lari onun katidir, munmap(arena, size) aynen calisir
+    int is_huge;
+
+    // NUMA modunda arenanin baglandigi node, -1 ise baglanmamis (her node'dan thread kullanabilir)
+    int numa_node;
+
+    // deferred coalescing acik mi (1) kapali mi (0), arena bazinda degistirilebilir
+    int deferred_coalesce;
+
+    // heapster_reserve ile onceden alinip doldurulmus arena, bosalsa da yok edilmez ve purge edilmez
+    int is_reserved;
+
+    // shared memory'de (shm.c): kilit process'ler arasi, free'ler remote kuyruga gitmez
+    int is_shared;
+
+    // listeden cikarildiktan sonra geri verilmek icin beklerken retired listesindeki sira ve
+    // cikarildigi epoch. sadece heap->list_lock altinda kullanilir
+    uint64_t retire_epoch;
+    struct arena *retired_next;
+
+    // arenayi olusturan thread. baska threadlerden gelen free'ler kilidi almaz,
+    // remote_free_head'e itilir ve sonra toplu bosaltilir
+    pthread_t owner;
+    _Atomic int owner_exited;  // sahip thread bitti, free'ler kilitle yapilir (arena_owner_exit)
+
+    /* ---- remote free ---- */
+
+    // sahibi olmayan threadlerin free ettigi blocklarin kilitsiz MPSC stack'i, block->next ile bagli.
+    // ureticiler sadece CAS ile push eder, kilidi tutan zincirin tamamini tek exchange ile alir
+    alignas(HEAPSTER_CACHE_LINE) _Atomic(struct block_header *) remote_free_head;
+    _Atomic size_t remote_free_bytes;  // kuyruktaki blocklarin payload toplami, doluluk tahmini icin
+
+    /* ---- occupancy hints ---- */
+
+    // arena_unlock'ta lock altindaki statlardan kopyalanir, malloc arena secerken kilitsiz okur.
+    // bayat olabilirler, sadece tercih icin kullanilir (arena_alloc yine kilit altinda bakar)
+    alignas(HEAPSTER_CACHE_LINE) _Atomic size_t free_hint;     // stats.free_bytes
+    _Atomic size_t largest_hint;                               // en buyuk free block payload'i
+    _Atomic unsigned frag_hint;                                // fragmentation_ratio * 1000
+
+    /* ---- lock protected mutable state ---- */
+
+    // for thread safe alocation. dogrudan degil arena_lock / arena_unlock ile kullanilir (lock.c)
+    alignas(HEAPSTER_CACHE_LINE) heapster_lock_t lock;       
+
+    // free blocklari tutan listin basi
+    struct block_header *free_list_head;  
+
+    // policy olarak find_next_fir icin cursor pointer
+    struct block_header *next_fit_cursor;
+
+    // free list'teki buyuk blocklarin size indexi (tree.c), best fit O(log n), worst fit O(1)
+    struct block_header *free_tree_root;
+    struct block_header *free_tree_max;
+    size_t tiny_free_count;  // tree'ye giremeyen free block sayisi
+
+    int64_t block_count;
+
+    // listeden cikarildi, okuyucular hala tutuyor olabilir ama artik block verilmez
+    int dead;
+
+    // son purge zamani (CLOCK_MONOTONIC ns), 0 = henuz baslamadi
+    uint64_t last_purge_ns;
+
+    // exact size quick listler, block->next ile bagli tek yonlu LIFO listeler
+    struct block_header *quick_bins[QUICK_BIN_COUNT];
+    size_t quick_count;
+
+    // heap policy'si HEAPSTER_ADAPTIVE iken bu arenanin secimi ve olcumleri
+    policy_adaptive_t adaptive;
+
+    /* ---- statistics ---- */
+
     // birden fazla arena olan sistemlerde her arena gomulu kendi statini tutsun diye
     // neden pointer degil -> ayni yerde bulunur direk arena ile ve 'cache locality' saglar
-    heapster_stats_t stats;
+    // cagri sayaclari burada degil counters'ta, okumak icin arena_stats_snapshot
+    alignas(HEAPSTER_CACHE_LINE) heapster_stats_t stats;
 
-    // global stati ayarlayabilmek icin tum arenalari gezmek lazim
-    struct arena *next;
-
-    // nasil allocate edildigi mmap mi sbrk mi mmap ise 1 sbrk ise 0
-    int is_mmap;
+    arena_counter_shard_t counters[ARENA_COUNTER_SHARDS];
     
 } arena_t;
 
@@ -87,9 +317,31 @@ typedef struct arena {
 
 #define BLOCK_MIN_SIZE (BLOCK_HEADER_SIZE + MIN_PAYLOAD_SIZE)
 
+// payload'i en az bu kadar olan free blocklar free tree'ye girer
+#define FREE_TREE_MIN_SIZE \
+    ((sizeof(free_tree_node_t) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
 #define ARENA_HEADER_SIZE \
     ((sizeof(arena_t) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
 
+// doluluk binde bu degerin (%25) altindaki arenalara baska yer varken yeni block verilmez, bosalip yok
+// edilebilsinler (ya da purge) diye. iki arena dolulugu bu kadar yakinsa az parcali olan secilir
+#define ARENA_DRAIN_PERMILLE 250
+#define ARENA_OCCUPANCY_TIE_PERMILLE 50
+
+// arena_create_ex flagleri
+#define ARENA_CREATE_MMAP       0x1  // boyuttan bagimsiz mmap
+#define ARENA_CREATE_POPULATE   0x2  // MAP_POPULATE ile sayfalari hemen doldur
+#define ARENA_CREATE_RESERVED   0x4  // is_reserved = 1
+#define ARENA_CREATE_NO_PUBLISH 0x8  // listeye ekleme, caller arena_publish cagirir
+
+// block->check'in ust biti: payload + requested_size'ta canary var. alt 31 bit header checksum'i
+#define CHECK_CANARY_BIT 0x80000000u
+#define CHECK_CANARY_SIZE 8
+
+// x86_64 ve aarch64'te (4K sayfa ile) PMD boyutu, THP ve hugetlbfs'in varsayilan huge page'i
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
 #define ARENA_MIN_SIZE (ARENA_HEADER_SIZE + BLOCK_MIN_SIZE + (ALIGNMENT - 1))
 // sondaki alignment - 1 kismi bir alignment isleminde kaybolabilecek max deger
 
@@ -5,6 +5,7 @@
 
 #include "internal.h"
 #include "stats.h"
+#include "heapster.h"
 
 //block.c
 block_header_t *block_init(void *addr, size_t arena_size);
@@ -16,19 +17,157 @@ block_header_t *block_split(arena_t *arena, block_header_t *block, size_t size);
 block_header_t *block_coalesce(arena_t *arena, block_header_t *block);
 int block_validate(block_header_t *block);
 
+//check.c
+int check_sample(void);
+void check_arm(block_header_t *block, int level);
+int check_armed_level(const block_header_t *block);
+int check_before_free(block_header_t *block, const char *op);
+uint64_t check_error_count(void);
+
+//tree.c
+void free_tree_reset(arena_t *arena);
+void free_tree_insert(arena_t *arena, block_header_t *block);
+void free_tree_remove(arena_t *arena, block_header_t *block);
+block_header_t *free_tree_lower_bound(arena_t *arena, size_t size, uint64_t *steps);
+
+//numa.c
+int numa_mode_enabled(void);
+int numa_current_node(void);
+int numa_bind_range(void *addr, size_t len, int node);
+
+//lock.c
+int lock_default_kind(void);
+void lock_init(heapster_lock_t *lock, int kind);
+void lock_init_shared(heapster_lock_t *lock, int kind);
+void lock_destroy(heapster_lock_t *lock);
+int lock_acquire(heapster_lock_t *lock, uint64_t *wait_ns);
+int lock_try_acquire(heapster_lock_t *lock);
+void lock_release(heapster_lock_t *lock);
+
+//epoch.c
+void epoch_enter(void);
+void epoch_exit(void);
+int epoch_in_read_section(void);
+uint64_t epoch_advance(void);
+int epoch_is_safe(uint64_t retire_epoch);
+void epoch_synchronize(uint64_t retire_epoch);
+void epoch_reset_after_fork(void);
+
+//rt.c
+int rt_owns(const void *ptr);
+int rt_thread_enabled(void);
+void *rt_malloc(size_t size);
+void rt_free(void *ptr);
+void *rt_realloc(void *ptr, size_t size);
+void rt_lock(void);
+void rt_unlock(void);
+void rt_reinit_after_fork(void);
+void rt_dump(void);
+
+//profile.c
+void profile_sample(void *ptr);
+void profile_forget(void *ptr);
+int profile_get_signal(void);
+void profile_lock(void);
+void profile_unlock(void);
+void profile_reinit_after_fork(void);
+
+//config.c
+void config_ensure_loaded(void);
+size_t config_next_arena_size(heapster_heap_t *heap, size_t needed);
+int config_parse(heapster_config_t *cfg, const char *text);
+void config_apply_to_heap(heapster_heap_t *heap, const heapster_config_t *cfg);
+
+//memops.c
+void memops_copy(void *dst, const void *src, size_t n);
+void memops_zero(void *dst, size_t n);
+void memops_move(void *dst, void *src, size_t n, int remap);
+
+//persist.c
+void persist_close(heapster_heap_t *heap);
+void persist_drop_after_fork(heapster_heap_t *heap);
+
+//shm.c
+arena_t *shm_find_arena(uint64_t id);
+void shm_dump(void);
+void shm_detach_all(void);
+
+//heap.c
+heapster_heap_t *heap_registry_first(void);
+void heap_fork_prepare(void);
+void heap_fork_parent(void);
+void heap_fork_child(void);
+void heap_release_all(void);
+
+//heapster.c
+heapster_policy_t heap_get_policy(heapster_heap_t *heap);
+void heap_free_direct(void *ptr);
+
+//tcache.c
+void *tcache_malloc(int cls, size_t size);
+int tcache_free(block_header_t *block);
+void tcache_invalidate_all(void);
+size_t tcache_cached_blocks(void);
+
+//budget.c
+int budget_charge(heapster_heap_t *heap, size_t bytes, int enforce);
+void budget_uncharge(heapster_heap_t *heap, size_t bytes);
+void budget_handle_pressure(heapster_heap_t *heap);
+void budget_dump(heapster_heap_t *heap);
+
+//deferred.c
+void deferred_invalidate_all(void);
+int deferred_release_heap(heapster_heap_t *heap);
+void deferred_lock_for_fork(void);
+void deferred_unlock_for_fork(void);
+void deferred_reinit_after_fork(void);
+void deferred_dump(void);
+
+//fork.c
+void fork_handlers_install(void);
+
 //arena.c
-arena_t *arena_create(size_t size);
-arena_t *arena_get_list(void);
-int last_cleanup(void);
-block_header_t *arena_find_free_block(arena_t *arena, size_t size);
+void arena_lock(arena_t *arena);
+void arena_unlock(arena_t *arena);
+unsigned arena_occupancy_permille(arena_t *arena);
+arena_t *arena_create(heapster_heap_t *heap, size_t size);
+arena_t *arena_create_ex(heapster_heap_t *heap, size_t size, int flags);
+void arena_publish(arena_t *arena);
+arena_t *arena_format(heapster_heap_t *heap, void *addr, size_t size);
+arena_t *arena_adopt(heapster_heap_t *heap, void *addr, size_t size);
+arena_t *arena_get_list(heapster_heap_t *heap);
+void arena_release_all(heapster_heap_t *heap);
+void *arena_alloc(arena_t *arena, size_t aligned_payload_size, size_t size);
 void arena_destroy(arena_t *arena);
+int arena_free_block(arena_t *arena, block_header_t *block);
+int arena_remote_free(arena_t *arena, block_header_t *block);
+int arena_drain_remote_frees(arena_t *arena);
+int arena_reap_remote_frees(arena_t *arena);
+size_t arena_consolidate(arena_t *arena);
+arena_t *arena_find_by_id(uint64_t id);
+void arena_collect_retired(heapster_heap_t *heap);
+void heap_set_mmap_threshold(heapster_heap_t *heap, size_t bytes);
+void arena_set_quick_limits(heapster_heap_t *heap, size_t max_size, size_t consolidate_threshold);
+void arena_set_purge_decay(heapster_heap_t *heap, unsigned decay_ms);
+size_t arena_purge(arena_t *arena);
+void arena_maybe_purge(arena_t *arena);
+size_t arena_huge_backed_bytes(arena_t *arena);
+void arena_lock_all(heapster_heap_t *heap);
+void arena_unlock_all(heapster_heap_t *heap);
+void arena_reinit_after_fork(heapster_heap_t *heap);
+void heap_dump(heapster_heap_t *heap);
 
 //stats.c
 void arena_stats_reset(arena_t *arena);
-void heapster_stats_update_global(heapster_stats_t *stats);
+void heapster_stats_update_global(heapster_heap_t *heap, heapster_stats_t *stats);
+void arena_counter_add(arena_t *arena, arena_counter_t counter, int64_t delta);
+uint64_t arena_counter_sum(arena_t *arena, arena_counter_t counter);
+void arena_stats_snapshot(arena_t *arena, heapster_stats_t *out);
 
 // policy.c
 block_header_t *policy_find_block(arena_t *arena, size_t size);
+void policy_adaptive_reset(arena_t *arena);
+const char *policy_name(int policy);
 
 void arena_dump(arena_t *arena);
 
@@ -0,0 +1,31 @@
+#ifndef HEAPSTER_LOCK_H
+#define HEAPSTER_LOCK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+arena kilidi. hangi turun kullanilacagi arena olusturulurken secilir (heapster_set_lock_kind)
+ve arena yasadigi surece degismez. kind degerleri heapster_lock_kind_t ile ayni
+*/
+typedef struct {
+    int kind;
+    int pshared;  // 1 = shared memory'de, baska process'lerle de kullanilir (lock_init_shared)
+
+    union {
+        // HEAPSTER_LOCK_MUTEX
+        pthread_mutex_t mutex;
+
+        // HEAPSTER_LOCK_ADAPTIVE, futex kelimesi: 0 = bos, 1 = kilitli, 2 = kilitli ve bekleyen var
+        _Atomic uint32_t word;
+
+        // HEAPSTER_LOCK_TICKET, sira numarasi alinir ve now_serving ona gelene kadar beklenir (FIFO)
+        struct {
+            _Atomic uint32_t next_ticket;
+            _Atomic uint32_t now_serving;
+        } ticket;
+    } u;
+} heapster_lock_t;
+
+#endif // end of HEAPSTER_LOCK_H
@@ -16,10 +16,24 @@ typedef struct {
     size_t wasted_bytes;       // requested_size < block->size oldugunda olusan internal fragmentation
     double fragmentation_ratio; // (1 - largest_free_block / free_bytes) gibi bir oran
 
+    size_t huge_bytes;         // arenanin huge page ile desteklenen kismi (THP icin smaps'teki AnonHugePages, hugetlb icin tamami), arena->stats'ta tutulmaz
+    size_t purged_bytes;       // arena_purge ile kernel'e geri verilen (MADV_DONTNEED) toplam byte
+
     uint64_t malloc_calls;      // malloc cagri sayisi
     uint64_t free_calls;       // free cagri sayisi
     uint64_t realloc_calls;    // realloc cagri sayisi
     uint64_t calloc_calls;     // calloc cagri sayisi
+    uint64_t quick_hits;       // quick bin'den direk karsilanan malloc sayisi
+    uint64_t consolidations;   // toplu birlestirme (arena_consolidate) sayisi
+    uint64_t remote_free_calls; // baska thread'den gelip remote free queue uzerinden drain edilen free sayisi
+
+    uint64_t lock_contended;   // arena kilidinin hemen alinamadigi (beklenen) sefer sayisi
+    uint64_t lock_wait_ns;     // bu beklemelerde gecen toplam sure (ns)
+
+    uint64_t policy_searches;     // policy_find_block cagri sayisi
+    uint64_t policy_search_steps; // bu aramalarda bakilan free block / tree node sayisi
+    uint64_t policy_switches;     // ADAPTIVE'in bu arenada policy degistirme sayisi
+    uint64_t free_list_steps;     // free'de adres sirali free list'te yurunen block sayisi (parcalanmanin bedeli)
 } heapster_stats_t;
 
 #endif 
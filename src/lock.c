@@ -0,0 +1,276 @@
+// lock.c
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+arena kilidi eskiden duz pthread_mutex_t idi. kritik bolgelerimiz birkac yuz ns, bekleyen
+thread hemen futex ile uyutulunca uyanma maliyeti isin kendisinden fazla oluyordu. burada
+arena kilidi icin uc tur var:
+
+MUTEX    -> eski davranis, pthread_mutex_t
+ADAPTIVE -> once artan bekleme ile (exponential backoff) donerek dener, olmadiysa futex ile
+            uyur. kilit kisa tutuluyorsa cogu zaman hic uyumadan alinir (varsayilan)
+TICKET   -> sira numarasi ile FIFO kilit, yogun cekismede hicbir thread ac kalmaz ama
+            sahibi uyursa arkasindaki herkes bekler, o yuzden uzun beklemede sched_yield yapar
+
+kilit hemen alinamadiysa (cekisme) beklenen sure ns olarak doner, arena_lock bunu arena
+statlarina yazar (lock_contended, lock_wait_ns). cekismesiz yolda saat okunmaz.
+*/
+
+#define LOCK_SPIN_LIMIT    64   // park etmeden once kac kez denenir
+#define LOCK_BACKOFF_MAX   256  // iki deneme arasi en fazla kac pause
+#define TICKET_YIELD_AFTER 1024 // ticket kilitte bu kadar pause sonrasi cpu birakilir
+
+static int default_lock_kind = HEAPSTER_LOCK_ADAPTIVE;
+
+// sadece bundan sonra olusturulacak arenalari etkiler
+void heapster_set_lock_kind(heapster_lock_kind_t kind) {
+    if (kind != HEAPSTER_LOCK_MUTEX && kind != HEAPSTER_LOCK_ADAPTIVE && kind != HEAPSTER_LOCK_TICKET) {
+        return;
+    }
+    default_lock_kind = kind;
+}
+
+heapster_lock_kind_t heapster_get_lock_kind(void) {
+    return (heapster_lock_kind_t)default_lock_kind;
+}
+
+int lock_default_kind(void) {
+    return default_lock_kind;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+// tek cpu'da donmenin anlami yok, kilidi tutan thread biz donerken calisamaz
+static int lock_single_cpu(void) {
+    static _Atomic int cpus = 0;
+
+    int n = atomic_load_explicit(&cpus, memory_order_relaxed);
+    if (n == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        n = online > 0 ? (int)online : 1;
+        atomic_store_explicit(&cpus, n, memory_order_relaxed);
+    }
+    return n == 1;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// process'ler arasi kilitte private futex kullanilamaz, kernel onu adres alanina gore eslestirir
+static void futex_wait(_Atomic uint32_t *word, uint32_t expected, int pshared) {
+#ifdef SYS_futex
+    syscall(SYS_futex, (uint32_t *)word, pshared ? 0 /* FUTEX_WAIT */ : 128 /* FUTEX_WAIT_PRIVATE */,
+            expected, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)expected;
+    (void)pshared;
+    sched_yield();
+#endif
+}
+
+static void futex_wake_one(_Atomic uint32_t *word, int pshared) {
+#ifdef SYS_futex
+    syscall(SYS_futex, (uint32_t *)word, pshared ? 1 /* FUTEX_WAKE */ : 129 /* FUTEX_WAKE_PRIVATE */,
+            1, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)pshared;
+#endif
+}
+
+void lock_init(heapster_lock_t *lock, int kind) {
+    lock->kind = kind;
+    lock->pshared = 0;
+
+    switch (kind) {
+        case HEAPSTER_LOCK_ADAPTIVE:
+            atomic_init(&lock->u.word, 0);
+            break;
+        case HEAPSTER_LOCK_TICKET:
+            atomic_init(&lock->u.ticket.next_ticket, 0);
+            atomic_init(&lock->u.ticket.now_serving, 0);
+            break;
+        default:
+            lock->kind = HEAPSTER_LOCK_MUTEX;
+            pthread_mutex_init(&lock->u.mutex, NULL);
+            break;
+    }
+}
+
+// shared memory'deki arena icin (shm.c), ayni kilidi birden fazla process kullanir
+void lock_init_shared(heapster_lock_t *lock, int kind) {
+    lock_init(lock, kind);
+    lock->pshared = 1;
+
+    if (lock->kind == HEAPSTER_LOCK_MUTEX) {
+        pthread_mutexattr_t attr;
+        pthread_mutex_destroy(&lock->u.mutex);
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&lock->u.mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+}
+
+void lock_destroy(heapster_lock_t *lock) {
+    if (lock->kind == HEAPSTER_LOCK_MUTEX) {
+        pthread_mutex_destroy(&lock->u.mutex);
+    }
+}
+
+// Drepper'in "Futexes Are Tricky" mutex'i, park etmeden once backoff ile doner
+static void adaptive_acquire_slow(heapster_lock_t *lock) {
+    unsigned backoff = 1;
+    int spin_limit = lock_single_cpu() ? 0 : LOCK_SPIN_LIMIT;
+
+    for (int spin = 0; spin < spin_limit; spin++) {
+        for (unsigned i = 0; i < backoff; i++) {
+            cpu_relax();
+        }
+
+        uint32_t expected = 0;
+        if (atomic_load_explicit(&lock->u.word, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_weak_explicit(&lock->u.word, &expected, 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return;
+        }
+
+        if (backoff < LOCK_BACKOFF_MAX) {
+            backoff <<= 1;
+        }
+    }
+
+    // 2 yazilir ki birakan thread uyandirmasi gerektigini bilsin
+    while (atomic_exchange_explicit(&lock->u.word, 2, memory_order_acquire) != 0) {
+        futex_wait(&lock->u.word, 2, lock->pshared);
+    }
+}
+
+static void ticket_wait(heapster_lock_t *lock, uint32_t ticket) {
+    unsigned spins = 0;
+    int single_cpu = lock_single_cpu();
+
+    for (;;) {
+        uint32_t serving = atomic_load_explicit(&lock->u.ticket.now_serving, memory_order_acquire);
+        if (serving == ticket) {
+            return;
+        }
+
+        if (single_cpu) {
+            sched_yield();
+            continue;
+        }
+
+        // onumuzde ne kadar cok thread varsa o kadar uzun bekle, herkes ayni satiri dovmesin
+        unsigned distance = ticket - serving;
+        for (unsigned i = 0; i < distance * 16; i++) {
+            cpu_relax();
+        }
+
+        spins += distance * 16;
+        if (spins >= TICKET_YIELD_AFTER) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+}
+
+/*
+kilidi alir. hemen alindiysa 0 doner, cekisme olduysa 1 doner ve wait_ns'e beklenen sure yazilir
+*/
+int lock_acquire(heapster_lock_t *lock, uint64_t *wait_ns) {
+    uint64_t start;
+
+    switch (lock->kind) {
+        case HEAPSTER_LOCK_ADAPTIVE: {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&lock->u.word, &expected, 1,
+                                                        memory_order_acquire, memory_order_relaxed)) {
+                return 0;
+            }
+            start = now_ns();
+            adaptive_acquire_slow(lock);
+            break;
+        }
+        case HEAPSTER_LOCK_TICKET: {
+            uint32_t ticket = atomic_fetch_add_explicit(&lock->u.ticket.next_ticket, 1, memory_order_relaxed);
+            if (atomic_load_explicit(&lock->u.ticket.now_serving, memory_order_acquire) == ticket) {
+                return 0;
+            }
+            start = now_ns();
+            ticket_wait(lock, ticket);
+            break;
+        }
+        default:
+            if (pthread_mutex_trylock(&lock->u.mutex) == 0) {
+                return 0;
+            }
+            start = now_ns();
+            pthread_mutex_lock(&lock->u.mutex);
+            break;
+    }
+
+    if (wait_ns) {
+        *wait_ns = now_ns() - start;
+    }
+    return 1;
+}
+
+// beklemeden dener, alindiysa 1. ticket kilitte sira bos degilse alinmaz
+int lock_try_acquire(heapster_lock_t *lock) {
+    switch (lock->kind) {
+        case HEAPSTER_LOCK_ADAPTIVE: {
+            uint32_t expected = 0;
+            return atomic_compare_exchange_strong_explicit(&lock->u.word, &expected, 1,
+                                                           memory_order_acquire, memory_order_relaxed);
+        }
+        case HEAPSTER_LOCK_TICKET: {
+            uint32_t serving = atomic_load_explicit(&lock->u.ticket.now_serving, memory_order_acquire);
+            return atomic_compare_exchange_strong_explicit(&lock->u.ticket.next_ticket, &serving, serving + 1,
+                                                           memory_order_acquire, memory_order_relaxed);
+        }
+        default:
+            return pthread_mutex_trylock(&lock->u.mutex) == 0;
+    }
+}
+
+void lock_release(heapster_lock_t *lock) {
+    switch (lock->kind) {
+        case HEAPSTER_LOCK_ADAPTIVE:
+            // 1'den dusuyorsak bekleyen yok, 2 idiyse biri uyuyor olabilir
+            if (atomic_fetch_sub_explicit(&lock->u.word, 1, memory_order_release) != 1) {
+                atomic_store_explicit(&lock->u.word, 0, memory_order_release);
+                futex_wake_one(&lock->u.word, lock->pshared);
+            }
+            break;
+        case HEAPSTER_LOCK_TICKET:
+            // sadece sahibi yazar, siradaki ticket'a gecer
+            atomic_store_explicit(&lock->u.ticket.now_serving,
+                                  atomic_load_explicit(&lock->u.ticket.now_serving, memory_order_relaxed) + 1,
+                                  memory_order_release);
+            break;
+        default:
+            pthread_mutex_unlock(&lock->u.mutex);
+            break;
+    }
+}
@@ -0,0 +1,213 @@
+// memops.c
+#define _GNU_SOURCE // mremap
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MEMOPS_X86 1
+#endif
+
+/*
+Bu dosya ne ise yarar?
+realloc'taki kopya ve calloc'taki sifirlama duz memcpy/memset idi. megabyte'lik bufferlarda
+bunlar cache'i caller'in yakinda dokunmayacagi veriyle doldurup working set'ini atiyordu.
+burada boyuta gore secilen kopya ve sifirlama kernelleri var:
+
+- nontemporal_threshold altinda: libc memcpy/memset (kucuk boyutlarda zaten en iyisi)
+- ustunde: non-temporal (streaming) store'lar, veri cache'e yazilmadan bellege gider.
+  AVX2 varsa 32 byte'lik, yoksa SSE2 ile 16 byte'lik kernel calisma aninda secilir.
+  x86_64 disinda hep libc kullanilir
+- realloc'ta eski ve yeni block mmap arenalardaysa ve sayfa icindeki offsetleri ayniysa tam
+  sayfalar kopyalanmaz, mremap(MREMAP_DONTUNMAP) ile yeni adrese tasinir. eski aralik
+  eslenmis kalir (dokunulursa sifir sayfa), arena ve block header'lari yerinde durur.
+  kernel desteklemiyorsa (5.7 oncesi, hugetlbfs) normal kopyaya duser
+*/
+
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4
+#endif
+
+// bundan kucuk tasimalarda syscall + VMA bolunmesi kopyadan pahali
+#define MEMOPS_REMAP_MIN (1024 * 1024)
+
+// 0 = streaming kapali. acikken en az bir sayfa, hizalama basi ve kuyrugu kernel'de sorun olmasin
+static _Atomic size_t nontemporal_threshold = 2 * 1024 * 1024;
+
+void heapster_set_nontemporal_threshold(size_t bytes) {
+    if (bytes != 0 && bytes < 4096) {
+        bytes = 4096;
+    }
+    atomic_store(&nontemporal_threshold, bytes);
+}
+
+size_t heapster_get_nontemporal_threshold(void) {
+    return atomic_load(&nontemporal_threshold);
+}
+
+#ifdef MEMOPS_X86
+
+#define MEMOPS_ISA_UNKNOWN 0
+#define MEMOPS_ISA_SSE2    1
+#define MEMOPS_ISA_AVX2    2
+
+// yarisan threadler ayni degeri yazar, kilit gerekmez
+static _Atomic int memops_isa = MEMOPS_ISA_UNKNOWN;
+
+static int memops_detect(void) {
+    int isa = atomic_load_explicit(&memops_isa, memory_order_relaxed);
+    if (isa == MEMOPS_ISA_UNKNOWN) {
+        __builtin_cpu_init();
+        isa = __builtin_cpu_supports("avx2") ? MEMOPS_ISA_AVX2 : MEMOPS_ISA_SSE2;
+        atomic_store_explicit(&memops_isa, isa, memory_order_relaxed);
+    }
+    return isa;
+}
+
+// dst 32'ye hizalanana kadarki bas ve 128'in altindaki kuyruk normal store ile yazilir
+__attribute__((target("avx2")))
+static void nt_copy_avx2(char *dst, const char *src, size_t n) {
+    size_t head = (32 - ((uintptr_t)dst & 31)) & 31;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    for (; n >= 128; n -= 128, dst += 128, src += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+        _mm256_stream_si256((__m256i *)dst, a);
+        _mm256_stream_si256((__m256i *)(dst + 32), b);
+        _mm256_stream_si256((__m256i *)(dst + 64), c);
+        _mm256_stream_si256((__m256i *)(dst + 96), d);
+    }
+    _mm_sfence();
+
+    memcpy(dst, src, n);
+}
+
+__attribute__((target("avx2")))
+static void nt_zero_avx2(char *dst, size_t n) {
+    size_t head = (32 - ((uintptr_t)dst & 31)) & 31;
+    memset(dst, 0, head);
+    dst += head;
+    n -= head;
+
+    __m256i z = _mm256_setzero_si256();
+    for (; n >= 128; n -= 128, dst += 128) {
+        _mm256_stream_si256((__m256i *)dst, z);
+        _mm256_stream_si256((__m256i *)(dst + 32), z);
+        _mm256_stream_si256((__m256i *)(dst + 64), z);
+        _mm256_stream_si256((__m256i *)(dst + 96), z);
+    }
+    _mm_sfence();
+
+    memset(dst, 0, n);
+}
+
+static void nt_copy_sse2(char *dst, const char *src, size_t n) {
+    size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, dst += 64, src += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+    }
+    _mm_sfence();
+
+    memcpy(dst, src, n);
+}
+
+static void nt_zero_sse2(char *dst, size_t n) {
+    size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+    memset(dst, 0, head);
+    dst += head;
+    n -= head;
+
+    __m128i z = _mm_setzero_si128();
+    for (; n >= 64; n -= 64, dst += 64) {
+        _mm_stream_si128((__m128i *)dst, z);
+        _mm_stream_si128((__m128i *)(dst + 16), z);
+        _mm_stream_si128((__m128i *)(dst + 32), z);
+        _mm_stream_si128((__m128i *)(dst + 48), z);
+    }
+    _mm_sfence();
+
+    memset(dst, 0, n);
+}
+
+#endif
+
+// araliklar cakismamali (memcpy gibi)
+void memops_copy(void *dst, const void *src, size_t n) {
+#ifdef MEMOPS_X86
+    size_t threshold = atomic_load_explicit(&nontemporal_threshold, memory_order_relaxed);
+    if (threshold != 0 && n >= threshold) {
+        if (memops_detect() == MEMOPS_ISA_AVX2) {
+            nt_copy_avx2(dst, src, n);
+        } else {
+            nt_copy_sse2(dst, src, n);
+        }
+        return;
+    }
+#endif
+    memcpy(dst, src, n);
+}
+
+void memops_zero(void *dst, size_t n) {
+#ifdef MEMOPS_X86
+    size_t threshold = atomic_load_explicit(&nontemporal_threshold, memory_order_relaxed);
+    if (threshold != 0 && n >= threshold) {
+        if (memops_detect() == MEMOPS_ISA_AVX2) {
+            nt_zero_avx2(dst, n);
+        } else {
+            nt_zero_sse2(dst, n);
+        }
+        return;
+    }
+#endif
+    memset(dst, 0, n);
+}
+
+/*
+realloc'un kopyasi. remap 1 ise iki block da private anonymous mmap arenalarda (hugetlbfs degil)
+ve caller ikisinin de sahibi: src'nin icindeki tam sayfalar dst'ye tasinir, bas ve kuyruk
+kopyalanir. tasinan sayfalar src'de sifirlanmis olur, caller src'yi zaten free edecek
+*/
+void memops_move(void *dst, void *src, size_t n, int remap) {
+    size_t page_size = (size_t)sysconf(_SC_PAGE_SIZE);
+
+    if (remap && n >= MEMOPS_REMAP_MIN && (((uintptr_t)dst ^ (uintptr_t)src) & (page_size - 1)) == 0) {
+        uintptr_t first = ((uintptr_t)src + page_size - 1) & ~(uintptr_t)(page_size - 1);
+        uintptr_t last = ((uintptr_t)src + n) & ~(uintptr_t)(page_size - 1);
+        size_t head = first - (uintptr_t)src;
+        size_t len = last - first;
+
+        // VMA sayisi siniri ya da eski kernel'de basarisiz olursa hicbir sey degismemis olur
+        if (last > first &&
+            mremap((void *)first, len, len, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP,
+                   (char *)dst + head) != MAP_FAILED) {
+            memcpy(dst, src, head);
+            memcpy((char *)dst + head + len, (const char *)last, n - head - len);
+            return;
+        }
+    }
+
+    memops_copy(dst, src, n);
+}
@@ -0,0 +1,79 @@
+// numa.c
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+NUMA modu: iki soketli makinelerde arena hafizasi ilk dokunan thread'in node'unda kaliyordu.
+Bu mod acikken her arena olusturuldugu thread'in node'una mbind ile baglanir (arena->numa_node)
+ve malloc sadece o anki node'a ait (ya da hic baglanmamis) arenalardan block secer.
+free zaten blockun kendi arenasina gittigi icin hafiza sahibi node'a geri doner.
+
+libnuma'ya bagimlilik olmasin diye mbind/getcpu dogrudan syscall ile cagrilir. destek yoksa
+(linux degil, syscall yok, tek node) her sey node 0 / baglanmamis gibi davranir, yani mod
+acik olsa bile davranis normal allocator ile aynidir.
+*/
+
+// <numaif.h> libnuma-dev ile geliyor, sadece bu sabit lazim
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static int numa_enabled = 0;
+
+void heapster_set_numa(int enabled) {
+    numa_enabled = enabled ? 1 : 0;
+}
+
+int heapster_get_numa(void) {
+    return numa_enabled;
+}
+
+int numa_mode_enabled(void) {
+    return numa_enabled;
+}
+
+// calisan thread'in o anki node'u, bilinmiyorsa 0
+int numa_current_node(void) {
+#ifdef SYS_getcpu
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+        return (int)node;
+    }
+#endif
+    return 0;
+}
+
+/*
+[addr, addr + len) araligini node'a baglar. addr page aligned olmak zorunda, o yuzden NUMA
+modunda arenalar her zaman mmap ile alinir. MPOL_BIND yerine MPOL_PREFERRED: node dolarsa
+kernel baska node'dan verir, OOM olmaktansa remote hafiza daha iyi. hata olursa (tek node,
+seccomp, eski kernel) sessizce -1 doner, arena yine de kullanilir
+*/
+int numa_bind_range(void *addr, size_t len, int node) {
+#ifdef SYS_mbind
+    if (node < 0) {
+        return -1;
+    }
+
+    unsigned long mask[(node / (8 * sizeof(unsigned long))) + 1];
+    for (size_t i = 0; i < sizeof(mask) / sizeof(mask[0]); i++) {
+        mask[i] = 0;
+    }
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+    unsigned long maxnode = (unsigned long)node + 2;
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, maxnode, 0) == 0) {
+        return 0;
+    }
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+#endif
+    return -1;
+}
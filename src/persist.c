@@ -0,0 +1,274 @@
+// persist.c
+#include <fcntl.h>
+#include <sys/file.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+cache servisi her restart'ta bellekteki yapilarini dakikalarca bastan kuruyordu. burada bir
+heap'in arenasi bir dosyadan MAP_SHARED ile map edilir, process kapaninca (ya da olunce) dosya
+heap'in son halini tutar ve heapster_heap_open_file ile tekrar acilip icindeki allocation'lar
+hemen kullanilabilir.
+
+dosya duzeni: | heap_file_header (1 sayfa) | arena header | block | block | ... |
+
+block header'lari hala mutlak pointer tutuyor (malloc/free'nin sicak yolu ve tum policy kodu
+onlara dayaniyor). bunun yerine acilista arena_adopt header'daki hicbir pointer'a guvenmez,
+zinciri sadece block size'larindan yurur ve pointer'lari, free list'i, tree'yi ve statlari
+yeniden kurar. boylece dosya baska bir adrese de map edilebilir (relocatable): allocator icin
+sorun olmaz, kullanicinin kendi verisindeki ham pointer'lar ise sadece ayni adrese map
+edilirse gecerli kalir. bu yuzden once dosyada yazan (son) adres denenir, root'a (kullanici
+yapilarinin girisi) her zaman offset uzerinden ulasilir.
+
+- heapster_heap_sync: arena kilidi altinda bekleyen remote free'ler bitirilir ve mapping
+  msync edilir, yani diske giden allocator metadata'si tutarlidir (checkpoint)
+- acilista tutarlilik kontrolu arena_adopt'ta, block_validate uzerine: bozuk dosya hic
+  degistirilmeden reddedilir. temiz kapanmamis (clean = 0) dosya da ayni kontrolden gecer
+- heap sabit boyutludur, dosya dolunca malloc NULL doner. arena hic purge/destroy edilmez
+- dosya acik kaldigi surece flock ile kilitli, ikinci bir open (ayni ya da baska process)
+  reddedilir
+- fork: MAP_SHARED mapping'i child ile paylasilir ve kilitler process'ler arasi degildir.
+  child'da dosya heap'leri bosaltilir (munmap), heap handle'i bos bir heap olarak kalir
+*/
+
+#define HEAP_FILE_MAGIC   0x5245545350414548ULL  // "HEAPSTER"
+#define HEAP_FILE_VERSION 1
+
+typedef struct heap_file_header {
+    uint64_t magic;
+    uint32_t version;
+
+    // layout degistiyse (baska build) blocklar ayni yerde degildir, acilmaz
+    uint32_t arena_header_size;
+    uint32_t block_header_size;
+    uint32_t alignment;
+
+    uint64_t size;        // dosyanin (ve mapping'in) boyutu
+    uint64_t base;        // en son map edildigi adres
+    uint64_t root;        // root payload'inin dosya basina gore offset'i, 0 = yok
+    uint64_t generation;  // heapster_heap_sync sayisi
+    uint32_t clean;       // heapster_heap_destroy ile kapandiysa 1
+} heap_file_header_t;
+
+static size_t persist_page_size(void) {
+    return (size_t)sysconf(_SC_PAGE_SIZE);
+}
+
+static int persist_header_ok(const heap_file_header_t *h, size_t file_size, const char *path) {
+    if (h->magic != HEAP_FILE_MAGIC || h->version != HEAP_FILE_VERSION) {
+        fprintf(stderr, "[heapster] heap_open_file: %s is not a heap file\n", path);
+        return 0;
+    }
+    if (h->arena_header_size != ARENA_HEADER_SIZE || h->block_header_size != BLOCK_HEADER_SIZE ||
+        h->alignment != ALIGNMENT) {
+        fprintf(stderr, "[heapster] heap_open_file: %s was written with a different layout\n", path);
+        return 0;
+    }
+    if (h->size != file_size || h->root >= file_size) {
+        fprintf(stderr, "[heapster] heap_open_file: %s is truncated or corrupted\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+want NULL degilse once orasi denenir. MAP_FIXED kullanilmaz (oradaki mapping'in ustune
+yazardi), kernel adres bossa ipucunu kullanir. strict ise baska adres kabul edilmez
+*/
+static void *persist_map(int fd, size_t size, void *want, int strict) {
+    void *addr = mmap(want, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    if (want && addr != want && strict) {
+        munmap(addr, size);
+        return MAP_FAILED;
+    }
+    return addr;
+}
+
+heapster_heap_t *heapster_heap_open_file(const char *path, size_t size, void *base) {
+    size_t page_size = persist_page_size();
+
+    if (!path) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "[heapster] heap_open_file: cannot open %s\n", path);
+        return NULL;
+    }
+
+    // ayni dosyayi baska bir heap (bu ya da baska process'te) kullaniyorsa iki taraf da
+    // metadata'yi kendi adresine gore yazip digerininkini bozardi
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "[heapster] heap_open_file: %s is already open\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    heap_file_header_t old;
+    int reopen = st.st_size != 0;
+    void *want = base;
+
+    if (reopen) {
+        if (pread(fd, &old, sizeof(old), 0) != (ssize_t)sizeof(old) ||
+            !persist_header_ok(&old, (size_t)st.st_size, path)) {
+            close(fd);
+            return NULL;
+        }
+        size = (size_t)st.st_size;
+        if (!want) {
+            want = (void *)(uintptr_t)old.base;
+        }
+    } else {
+        if (size < page_size + ARENA_MIN_SIZE) {
+            size = page_size + ARENA_MIN_SIZE;
+        }
+        size = (size + page_size - 1) & ~(page_size - 1);
+        if (ftruncate(fd, (off_t)size) != 0) {
+            fprintf(stderr, "[heapster] heap_open_file: cannot grow %s to %zu bytes\n", path, size);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    void *map = persist_map(fd, size, want, base != NULL);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[heapster] heap_open_file: cannot map %s%s\n", path, base ? " at the requested base" : "");
+        close(fd);
+        return NULL;
+    }
+
+    heapster_heap_t *heap = heapster_heap_create(NULL);
+    if (!heap) {
+        munmap(map, size);
+        close(fd);
+        return NULL;
+    }
+    heap->fixed_size = 1;
+    strncpy(heap->name, "file", sizeof(heap->name) - 1);
+
+    void *arena_addr = (char *)map + page_size;
+    arena_t *arena = reopen ? arena_adopt(heap, arena_addr, size - page_size)
+                            : arena_format(heap, arena_addr, size - page_size);
+    if (!arena) {
+        fprintf(stderr, "[heapster] heap_open_file: %s failed the consistency check\n", path);
+        heapster_heap_destroy(heap);
+        munmap(map, size);
+        close(fd);
+        return NULL;
+    }
+
+    heap_file_header_t *header = map;
+    if (!reopen) {
+        memset(header, 0, sizeof(*header));
+        header->magic = HEAP_FILE_MAGIC;
+        header->version = HEAP_FILE_VERSION;
+        header->arena_header_size = ARENA_HEADER_SIZE;
+        header->block_header_size = BLOCK_HEADER_SIZE;
+        header->alignment = ALIGNMENT;
+        header->size = size;
+    } else if (!header->clean) {
+        fprintf(stderr, "[heapster] heap_open_file: %s was not closed cleanly, recovered %lld blocks\n",
+                path, (long long)arena->block_count);
+    }
+    header->base = (uint64_t)(uintptr_t)map;
+    header->clean = 0;
+    msync(header, page_size, MS_SYNC);
+
+    heap->file = header;
+    heap->file_size = size;
+    heap->file_fd = fd;
+    arena_publish(arena);
+
+    return heap;
+}
+
+int heapster_heap_sync(heapster_heap_t *heap) {
+    if (!heap || !heap->file) {
+        return -1;
+    }
+
+    epoch_enter();
+
+    // kilit msync boyunca tutulur ki diske giden free list / block zinciri yari guncellenmis olmasin
+    arena_t *arena = arena_get_list(heap);
+    if (arena) {
+        arena_lock(arena);
+        arena_drain_remote_frees(arena);
+    }
+
+    heap->file->generation++;
+    int rc = msync(heap->file, heap->file_size, MS_SYNC);
+
+    if (arena) {
+        arena_unlock(arena);
+    }
+
+    epoch_exit();
+
+    return rc == 0 ? 0 : -1;
+}
+
+int heapster_heap_set_root(heapster_heap_t *heap, void *ptr) {
+    if (!heap || !heap->file) {
+        return -1;
+    }
+
+    uintptr_t start = (uintptr_t)heap->file + persist_page_size();
+    uintptr_t end = (uintptr_t)heap->file + heap->file_size;
+    if (ptr && ((uintptr_t)ptr < start || (uintptr_t)ptr >= end)) {
+        return -1;
+    }
+
+    heap->file->root = ptr ? (uint64_t)((uintptr_t)ptr - (uintptr_t)heap->file) : 0;
+    return 0;
+}
+
+void *heapster_heap_get_root(heapster_heap_t *heap) {
+    if (!heap || !heap->file || heap->file->root == 0) {
+        return NULL;
+    }
+    return (char *)heap->file + heap->file->root;
+}
+
+// heapster_heap_destroy'dan: son checkpoint, temiz kapandi isareti, sonra arena ve header geri verilir
+void persist_close(heapster_heap_t *heap) {
+    heap_file_header_t *header = heap->file;
+    size_t page_size = persist_page_size();
+
+    heapster_heap_sync(heap);
+    header->clean = 1;
+    msync(header, page_size, MS_SYNC);
+
+    arena_release_all(heap);  // arena header'dan sonraki sayfalar
+
+    heap->file = NULL;
+    munmap(header, page_size);
+    close(heap->file_fd);  // flock birakilir
+}
+
+// fork child'inda tek thread varken: paylasilan mapping birakilir, heap bos kalir
+void persist_drop_after_fork(heapster_heap_t *heap) {
+    atomic_store(&heap->arena_list_head, NULL);
+    heap->retired_list_head = NULL;
+
+    munmap(heap->file, heap->file_size);
+    heap->file = NULL;
+    close(heap->file_fd);  // flock parent'taki ayni fd ile tutulmaya devam eder
+}
@@ -15,8 +15,9 @@ Her strateji farkli seçim yontemidir:
 
 first fit   -> ilk sigan block'a yerlesir
 next fit    -> en son bakilan block’tan devam eder, gerekirse basa sarar
-best fit    -> uygun olan en küçük block’u seçer
-worst fit   -> uygun olan en büyük block’u seçer
+best fit    -> uygun olan en küçük block’u seçer (free tree, O(log n))
+worst fit   -> uygun olan en büyük block’u seçer (free tree max, O(1))
+adaptive    -> arena kendi olcumlerine gore yukaridakilerden birini secer, degistirir (asagida)
 
 yoksa null döner ona göre farklı arena denenir ya da yeni arena açılır
 
@@ -35,8 +36,9 @@ static inline int block_is_aligned(block_header_t *b) {
 }
 
 /* first fit */
-static block_header_t *find_first_fit(arena_t *arena, size_t size) {
+static block_header_t *find_first_fit(arena_t *arena, size_t size, uint64_t *steps) {
     for (block_header_t *cur = arena->free_list_head; cur; cur = cur->next) {
+        (*steps)++;
         if (cur->free && cur->size >= size && block_is_aligned(cur)) {
             return cur;
         }
@@ -45,7 +47,7 @@ static block_header_t *find_first_fit(arena_t *arena, size_t size) {
 }
 
 /* next fit */
-static block_header_t *find_next_fit(arena_t *arena, size_t size) {
+static block_header_t *find_next_fit(arena_t *arena, size_t size, uint64_t *steps) {
     if (!arena->next_fit_cursor) {
         arena->next_fit_cursor = arena->free_list_head;
     }
@@ -58,6 +60,7 @@ static block_header_t *find_next_fit(arena_t *arena, size_t size) {
     block_header_t *cur   = start;
 
     do {
+        (*steps)++;
         if (cur->free && cur->size >= size && block_is_aligned(cur)) {
             arena->next_fit_cursor = cur->next ? cur->next : arena->free_list_head;
             return cur;
@@ -70,36 +73,197 @@ static block_header_t *find_next_fit(arena_t *arena, size_t size) {
     return NULL;
 }
 
-/* best fit */
-static block_header_t *find_best_fit(arena_t *arena, size_t size) {
-    block_header_t *best = NULL;
-    size_t best_size = (size_t)-1;
+/*
+tree'ye girmeyen tiny blocklar arasinda size'i karsilayan en kucugu (tiny_free_count == 0 ise hic bakilmaz).
+tiny blocklar zaten en kucuk blocklar oldugu icin burada bulunan her zaman tree'dekinden daha iyi bir fit
+*/
+static block_header_t *find_tiny_fit(arena_t *arena, size_t size, uint64_t *steps) {
+    if (arena->tiny_free_count == 0 || size >= FREE_TREE_MIN_SIZE) {
+        return NULL;
+    }
 
+    block_header_t *best = NULL;
     for (block_header_t *cur = arena->free_list_head; cur; cur = cur->next) {
-        if (cur->free && cur->size >= size && block_is_aligned(cur)) {
-            if (cur->size < best_size) {
-                best_size = cur->size;
+        (*steps)++;
+        if (cur->size < FREE_TREE_MIN_SIZE && cur->size >= size && block_is_aligned(cur)) {
+            if (!best || cur->size < best->size) {
                 best = cur;
+                if (best->size == size) {
+                    break; // tam oturdu daha iyisi yok
+                }
             }
         }
     }
     return best;
 }
 
-/* worst fit */
-static block_header_t *find_worst_fit(arena_t *arena, size_t size) {
-    block_header_t *worst = NULL;
-    size_t worst_size = 0;
+/* best fit: free tree uzerinde lower bound, O(log n) */
+static block_header_t *find_best_fit(arena_t *arena, size_t size, uint64_t *steps) {
+    block_header_t *best = find_tiny_fit(arena, size, steps);
+    if (best) {
+        return best;
+    }
 
-    for (block_header_t *cur = arena->free_list_head; cur; cur = cur->next) {
-        if (cur->free && cur->size >= size && block_is_aligned(cur)) {
-            if (cur->size > worst_size) {
-                worst_size = cur->size;
-                worst = cur;
+    best = free_tree_lower_bound(arena, size, steps);
+    if (best && best->free && block_is_aligned(best)) {
+        return best;
+    }
+    return NULL;
+}
+
+/* worst fit: en buyuk block tree'de hazir tutuluyor, O(1) */
+static block_header_t *find_worst_fit(arena_t *arena, size_t size, uint64_t *steps) {
+    block_header_t *worst = arena->free_tree_max;
+
+    // tree bossa elde sadece tiny blocklar vardir
+    if (!worst) {
+        return find_tiny_fit(arena, size, steps);
+    }
+
+    (*steps)++;
+    if (worst->free && worst->size >= size && block_is_aligned(worst)) {
+        return worst;
+    }
+    return NULL;
+}
+
+/*
+adaptive: her arena aramalarini ADAPTIVE_WINDOW'luk pencerelerde olcer. pencere bitince o an
+kullanilan policy'nin maliyeti hesaplanir:
+
+  maliyet = (1 + aramada bakilan block/node + free'de yurunen block + miss * ADAPTIVE_MISS_COST) / arama
+            * (1 + 4 * limit ustundeyken artan fragmentation + 4 * limiti asan wasted/used)
+
+arama uzunlugu tek basina yaniltir: worst fit O(1) bulur ama arenayi parcalar, free list uzar
+ve her free adres sirali listede daha cok yurur. o yurume ve miss (arenada toplamda yer varken
+sigan block bulunamamasi, yani yeni arena ya da baska arena) parcalanmanin asil bedeli.
+fragmentation'in mutlak degeri degil pencere icindeki artisi cezalanir, bir onceki policy'nin
+biraktigi parcalanma onu toparlayan policy'ye yazilmasin diye.
+
+once dort policy sirayla birer pencere denenir, sonra en ucuzuna gecilir (mevcut olandan
+ADAPTIVE_HYSTERESIS kadar iyiyse, iki policy arasinda gidip gelmesin diye). is yuku degisebilir,
+her ADAPTIVE_EXPLORE_WINDOWS pencerede en eski olcumu olan policy bir pencere tekrar denenir.
+secim ve degisim sayisi heapster_status'ta gorunur
+*/
+#define ADAPTIVE_WINDOW           256
+#define ADAPTIVE_EXPLORE_WINDOWS  64
+#define ADAPTIVE_FRAG_LIMIT       0.5
+#define ADAPTIVE_WASTE_LIMIT      0.25
+#define ADAPTIVE_MISS_COST        64.0
+#define ADAPTIVE_HYSTERESIS       0.85
+
+const char *policy_name(int policy) {
+    switch (policy) {
+        case HEAPSTER_FIRST_FIT: return "first_fit";
+        case HEAPSTER_NEXT_FIT:  return "next_fit";
+        case HEAPSTER_BEST_FIT:  return "best_fit";
+        case HEAPSTER_WORST_FIT: return "worst_fit";
+        case HEAPSTER_ADAPTIVE:  return "adaptive";
+        default:                 return "unknown";
+    }
+}
+
+// arena_init_header'dan, arena henuz yayinlanmadi
+void policy_adaptive_reset(arena_t *arena) {
+    policy_adaptive_t *a = &arena->adaptive;
+
+    a->current = HEAPSTER_FIRST_FIT;
+    a->window_searches = 0;
+    a->window_misses = 0;
+    a->window_steps = 0;
+    a->window_free_steps_start = 0;
+    a->window_frag_start = 0.0;
+    a->windows = 0;
+    for (int p = 0; p < POLICY_CONCRETE_COUNT; p++) {
+        a->cost[p] = -1.0;
+        a->measured_at[p] = 0;
+    }
+}
+
+static double adaptive_window_cost(arena_t *arena) {
+    policy_adaptive_t *a = &arena->adaptive;
+
+    uint64_t free_steps = arena->stats.free_list_steps - a->window_free_steps_start;
+
+    double per_search = 1.0 + ((double)a->window_steps + (double)free_steps
+                               + ADAPTIVE_MISS_COST * a->window_misses) / a->window_searches;
+
+    double frag = arena->stats.fragmentation_ratio;
+    double waste = arena->stats.used_bytes > 0
+                 ? (double)arena->stats.wasted_bytes / (double)arena->stats.used_bytes : 0.0;
+
+    double penalty = 0.0;
+    if (frag > ADAPTIVE_FRAG_LIMIT && frag > a->window_frag_start) {
+        penalty += 4.0 * (frag - a->window_frag_start);
+    }
+    if (waste > ADAPTIVE_WASTE_LIMIT) {
+        penalty += 4.0 * (waste - ADAPTIVE_WASTE_LIMIT);
+    }
+
+    return per_search * (1.0 + penalty);
+}
+
+static int adaptive_choose(policy_adaptive_t *a) {
+    for (int p = 0; p < POLICY_CONCRETE_COUNT; p++) {
+        if (a->cost[p] < 0.0) {
+            return p;
+        }
+    }
+
+    if (a->windows % ADAPTIVE_EXPLORE_WINDOWS == 0) {
+        int oldest = -1;
+        for (int p = 0; p < POLICY_CONCRETE_COUNT; p++) {
+            if (p != a->current && (oldest < 0 || a->measured_at[p] < a->measured_at[oldest])) {
+                oldest = p;
             }
         }
+        return oldest;
+    }
+
+    int best = a->current;
+    for (int p = 0; p < POLICY_CONCRETE_COUNT; p++) {
+        if (a->cost[p] < a->cost[best]) {
+            best = p;
+        }
     }
-    return worst;
+    return a->cost[best] < a->cost[a->current] * ADAPTIVE_HYSTERESIS ? best : a->current;
+}
+
+// caller arena kilidini tutar
+static void adaptive_record(arena_t *arena, size_t size, block_header_t *found, uint64_t steps) {
+    policy_adaptive_t *a = &arena->adaptive;
+
+    if (a->window_searches == 0) {
+        a->window_frag_start = arena->stats.fragmentation_ratio;
+        a->window_free_steps_start = arena->stats.free_list_steps;
+    }
+    a->window_searches++;
+    a->window_steps += steps;
+    if (!found && arena->stats.free_bytes >= size) {
+        a->window_misses++;
+    }
+
+    if (a->window_searches < ADAPTIVE_WINDOW) {
+        return;
+    }
+
+    double cost = adaptive_window_cost(arena);
+    int cur = a->current;
+
+    // eski olcumun yarisi kalir, trend tek pencereyle tamamen silinmesin
+    a->cost[cur] = a->cost[cur] < 0.0 ? cost : 0.5 * a->cost[cur] + 0.5 * cost;
+    a->windows++;
+    a->measured_at[cur] = a->windows;
+
+    int next = adaptive_choose(a);
+    if (next != cur) {
+        a->current = next;
+        arena->stats.policy_switches++;
+    }
+
+    a->window_searches = 0;
+    a->window_misses = 0;
+    a->window_steps = 0;
 }
 
 block_header_t *policy_find_block(arena_t *arena, size_t size) {
@@ -107,20 +271,39 @@ block_header_t *policy_find_block(arena_t *arena, size_t size) {
         return NULL;
     }
 
-    switch (heapster_get_policy()) {
-        case HEAPSTER_FIRST_FIT:  
-            return find_first_fit(arena, size);
+    heapster_policy_t policy = heap_get_policy(arena->heap);
+    int adaptive = policy == HEAPSTER_ADAPTIVE;
+    if (adaptive) {
+        policy = (heapster_policy_t)arena->adaptive.current;
+    }
+
+    uint64_t steps = 0;
+    block_header_t *found;
 
-        case HEAPSTER_NEXT_FIT:   
-            return find_next_fit(arena, size);
-            
-        case HEAPSTER_BEST_FIT:   
-            return find_best_fit(arena, size);
+    switch (policy) {
+        case HEAPSTER_NEXT_FIT:
+            found = find_next_fit(arena, size, &steps);
+            break;
+
+        case HEAPSTER_BEST_FIT:
+            found = find_best_fit(arena, size, &steps);
+            break;
+
+        case HEAPSTER_WORST_FIT:
+            found = find_worst_fit(arena, size, &steps);
+            break;
+
+        case HEAPSTER_FIRST_FIT:
+        default:
+            found = find_first_fit(arena, size, &steps);
+            break;
+    }
 
-        case HEAPSTER_WORST_FIT:  
-            return find_worst_fit(arena, size);
+    arena->stats.policy_searches++;
+    arena->stats.policy_search_steps += steps;
 
-        default: 
-            return find_first_fit(arena, size);
+    if (adaptive) {
+        adaptive_record(arena, size, found, steps);
     }
+    return found;
 }
@@ -0,0 +1,456 @@
+// profile.c
+#define _GNU_SOURCE // dladdr
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+heap'in hangi kod yollari yuzunden buyudugunu gormek icin ornekleyen bir profiler.
+
+- her thread'in bir byte geri sayaci var (profile_countdown). malloc istenen boyutu duser,
+  sifirin altina inmedikce baska hicbir sey yapilmaz. altina indiginde profile_sample
+  backtrace alir ve sayaca ortalamasi sample_bytes olan rastgele bir adim ekler (sabit
+  aralik periyodik allocation desenleriyle hizalanip hep ayni yeri orneklerdi)
+- sayac asilan kismi da tasir (yenileme sureci), bir allocation'a k ornekleme noktasi
+  duserse ornek k * sample_bytes byte temsil eder, yani tahmin boyuttan bagimsiz olarak
+  yansiz. ayni stack'ten gelen ornekler stack tablosunda toplanir
+- ornek alinan pointer'lar live tablosunda (linear probing, silmede geri kaydirma, tombstone
+  yok) tutulur, free edilince stack'in canli byte'larindan duser. live tablosu bos degilken
+  free kilitsiz bir hash aramasi yapar, bos iken tek bir global okuma. silme sirasinda
+  kayan slotlari kilitsiz arayan kacirmasin diye silmeler profile_live_gen'i (seqlock) arttirir
+
+heapster_profile_dump canli byte'lari collapsed stack formatinda yazar (flamegraph.pl,
+speedscope, pprof'un collapsed import'u okur): "kok;...;yaprak byte". sinyal handler'i
+icinde dladdr/stdio kullanilamadigi icin heapster_profile_dump_on_signal bir dump thread'i
+acar, handler sadece sem_post yapar.
+
+tablolar sabit boyutlu static diziler (allocator kendi icinden malloc cagiramaz), dolarsa
+yeni ornekler dusurulur ve dropped sayilir.
+*/
+
+#define PROFILE_MAX_DEPTH 32
+#define PROFILE_SKIP_FRAMES 2          // profile_sample ve heapster_heap_malloc
+#define PROFILE_STACK_SLOTS 4096       // 2'nin kuvveti
+#define PROFILE_LIVE_SLOTS 65536       // 2'nin kuvveti
+#define PROFILE_LIVE_MAX (PROFILE_LIVE_SLOTS / 4 * 3)  // aramalar kisa kalsin diye en fazla doluluk
+#define PROFILE_OFF_RECHECK_BYTES ((int64_t)1 << 20)  // kapaliyken her thread bu kadar byte'ta bir acik mi diye bakar
+
+typedef struct {
+    uint64_t hash;  // 0 = bos slot
+    int depth;
+    void *frames[PROFILE_MAX_DEPTH];
+    _Atomic uint64_t live_bytes;
+    _Atomic uint64_t live_count;
+} profile_stack_t;
+
+typedef struct {
+    _Atomic(void *) ptr;  // NULL = bos
+    uint32_t stack;
+    size_t weight;
+} profile_live_t;
+
+static profile_stack_t profile_stacks[PROFILE_STACK_SLOTS];
+static profile_live_t profile_live[PROFILE_LIVE_SLOTS];
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic size_t profile_interval = 0;  // 0 = kapali
+static _Atomic uint64_t profile_dropped = 0;
+static _Atomic uint64_t profile_live_gen = 0;  // tek iken live tablosunda silme/kaydirma var
+_Atomic size_t profile_live_samples = 0;
+
+// 0'dan baslar, boylece her thread ilk malloc'ta bir kez profile_sample'a girip gercek araligi alir
+_Thread_local int64_t profile_countdown = 0;
+static _Thread_local uint64_t profile_rng = 0;
+static _Thread_local int profile_busy = 0;
+
+static sem_t profile_dump_sem;
+static _Atomic int profile_dumper_running = 0;
+static int profile_signo = 0;
+static char profile_signal_path[256];
+
+static inline uint64_t profile_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// ortalamasi interval olan uniform [1, 2 * interval] adim, libm gerektirmez
+static int64_t profile_next_countdown(size_t interval) {
+    if (profile_rng == 0) {
+        profile_rng = profile_mix((uint64_t)(uintptr_t)&profile_rng ^ (uint64_t)getpid()) | 1;
+    }
+    profile_rng ^= profile_rng << 13;
+    profile_rng ^= profile_rng >> 7;
+    profile_rng ^= profile_rng << 17;
+
+    return (int64_t)(profile_rng % (2 * (uint64_t)interval)) + 1;
+}
+
+// ayni stack icin var olan slotu ya da yeni bir slot, tablo doluysa -1. profile_mutex altinda
+static int profile_stack_slot(void **frames, int depth) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < depth; i++) {
+        h = profile_mix(h ^ (uint64_t)(uintptr_t)frames[i]);
+    }
+    if (h == 0) {
+        h = 1;
+    }
+
+    for (uint32_t n = 0; n < PROFILE_STACK_SLOTS; n++) {
+        uint32_t i = (uint32_t)(h + n) & (PROFILE_STACK_SLOTS - 1);
+        profile_stack_t *s = &profile_stacks[i];
+
+        if (s->hash == 0) {
+            s->hash = h;
+            s->depth = depth;
+            memcpy(s->frames, frames, sizeof(void *) * depth);
+            return (int)i;
+        }
+        if (s->hash == h && s->depth == depth && memcmp(s->frames, frames, sizeof(void *) * depth) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static inline uint32_t profile_ptr_slot(const void *ptr) {
+    return (uint32_t)profile_mix((uint64_t)(uintptr_t)ptr) & (PROFILE_LIVE_SLOTS - 1);
+}
+
+/*
+malloc'ta geri sayac sifirin altina inince cagrilir. profil kapaliysa sadece sayaci uzak bir
+yere kurar. boyut caller'da sayactan dusulmustur, ornegin agirligi sadece sayactan hesaplanir.
+backtrace ilk cagrisinda libgcc'yi yukleyip libc malloc'u cagirabilir, bizim
+malloc'umuza donmez ama yine de thread basina tekrar girilmez
+*/
+void profile_sample(void *ptr) {
+    size_t interval = atomic_load_explicit(&profile_interval, memory_order_relaxed);
+    if (interval == 0) {
+        profile_countdown = PROFILE_OFF_RECHECK_BYTES;
+        return;
+    }
+
+    // allocation'in icine dusen ornekleme noktasi sayisi kadar interval temsil eder, boylece
+    // kucuk ve buyuk allocation'lar icin de tahmin yansiz kalir
+    uint64_t points = 0;
+    while (profile_countdown < 0) {
+        profile_countdown += profile_next_countdown(interval);
+        points++;
+    }
+    size_t weight = (size_t)points * interval;
+
+    if (profile_busy) {
+        return;
+    }
+    profile_busy = 1;
+
+    void *frames[PROFILE_MAX_DEPTH + PROFILE_SKIP_FRAMES];
+    int depth = backtrace(frames, PROFILE_MAX_DEPTH + PROFILE_SKIP_FRAMES) - PROFILE_SKIP_FRAMES;
+    if (depth < 0) {
+        depth = 0;
+    }
+
+    pthread_mutex_lock(&profile_mutex);
+
+    int stack = profile_stack_slot(frames + PROFILE_SKIP_FRAMES, depth);
+    profile_live_t *slot = NULL;
+
+    if (stack >= 0 && atomic_load(&profile_live_samples) < PROFILE_LIVE_MAX) {
+        uint32_t i = profile_ptr_slot(ptr);
+        while (atomic_load_explicit(&profile_live[i].ptr, memory_order_relaxed) != NULL) {
+            i = (i + 1) & (PROFILE_LIVE_SLOTS - 1);
+        }
+        slot = &profile_live[i];
+    }
+
+    if (slot) {
+        slot->stack = (uint32_t)stack;
+        slot->weight = weight;
+        atomic_fetch_add_explicit(&profile_stacks[stack].live_bytes, weight, memory_order_relaxed);
+        atomic_fetch_add_explicit(&profile_stacks[stack].live_count, 1, memory_order_relaxed);
+        atomic_fetch_add(&profile_live_samples, 1);
+        // free tarafi ptr'yi gordugunde stack/weight hazir olmali
+        atomic_store_explicit(&slot->ptr, ptr, memory_order_release);
+    } else {
+        atomic_fetch_add_explicit(&profile_dropped, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&profile_mutex);
+
+    profile_busy = 0;
+}
+
+// ptr'nin live slotu, yoksa -1
+static int profile_live_find(const void *ptr) {
+    uint32_t i = profile_ptr_slot(ptr);
+    for (;;) {
+        void *cur = atomic_load_explicit(&profile_live[i].ptr, memory_order_acquire);
+        if (cur == NULL) {
+            return -1;
+        }
+        if (cur == ptr) {
+            return (int)i;
+        }
+        i = (i + 1) & (PROFILE_LIVE_SLOTS - 1);
+    }
+}
+
+/*
+slot i'yi bosaltir ve arkasindaki zinciri geri kaydirir (tombstone birakmadan), boylece
+silinen orneklerden sonra aramalar uzamaz. profile_mutex altinda
+*/
+static void profile_live_remove(uint32_t i) {
+    atomic_store_explicit(&profile_live_gen, atomic_load(&profile_live_gen) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&profile_live[i].ptr, NULL, memory_order_relaxed);
+
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & (PROFILE_LIVE_SLOTS - 1);
+        void *cur = atomic_load_explicit(&profile_live[j].ptr, memory_order_relaxed);
+        if (cur == NULL) {
+            break;
+        }
+
+        // home (k) dongusel olarak (i, j] araligindaysa j yerinde kalabilir
+        uint32_t k = profile_ptr_slot(cur);
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays) {
+            continue;
+        }
+
+        profile_live[i].stack = profile_live[j].stack;
+        profile_live[i].weight = profile_live[j].weight;
+        atomic_store_explicit(&profile_live[i].ptr, cur, memory_order_release);
+        atomic_store_explicit(&profile_live[j].ptr, NULL, memory_order_relaxed);
+        i = j;
+    }
+
+    atomic_store_explicit(&profile_live_gen, atomic_load(&profile_live_gen) + 1, memory_order_release);
+}
+
+/*
+ornek alinmis bir pointer free ediliyorsa stack'inden duser. caller profile_live_samples != 0
+gordu. ornek alinmamis pointer'lar (neredeyse hepsi) kilitsiz aramada bulunmaz ve o sirada
+silme olmadiysa kilide hic dokunmadan donulur
+*/
+void profile_forget(void *ptr) {
+    uint64_t gen = atomic_load_explicit(&profile_live_gen, memory_order_acquire);
+    if (!(gen & 1) && profile_live_find(ptr) < 0) {
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&profile_live_gen, memory_order_relaxed) == gen) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&profile_mutex);
+    int i = profile_live_find(ptr);
+    if (i >= 0) {
+        profile_stack_t *s = &profile_stacks[profile_live[i].stack];
+        atomic_fetch_sub_explicit(&s->live_bytes, profile_live[i].weight, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&s->live_count, 1, memory_order_relaxed);
+        profile_live_remove((uint32_t)i);
+        atomic_fetch_sub(&profile_live_samples, 1);
+    }
+    pthread_mutex_unlock(&profile_mutex);
+}
+
+int heapster_profile_start(size_t sample_bytes) {
+    if (sample_bytes == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&profile_mutex);
+
+    // yeni bir profil: onceki ornekler silinir. calisirken cagrilirsa sadece aralik degisir
+    if (atomic_load(&profile_interval) == 0) {
+        atomic_store(&profile_live_samples, 0);
+        atomic_store(&profile_live_gen, atomic_load(&profile_live_gen) + 1);
+        for (size_t i = 0; i < PROFILE_LIVE_SLOTS; i++) {
+            atomic_store_explicit(&profile_live[i].ptr, NULL, memory_order_relaxed);
+        }
+        atomic_store(&profile_live_gen, atomic_load(&profile_live_gen) + 1);
+        for (size_t i = 0; i < PROFILE_STACK_SLOTS; i++) {
+            profile_stacks[i].hash = 0;
+            atomic_store_explicit(&profile_stacks[i].live_bytes, 0, memory_order_relaxed);
+            atomic_store_explicit(&profile_stacks[i].live_count, 0, memory_order_relaxed);
+        }
+        atomic_store(&profile_dropped, 0);
+    }
+    atomic_store(&profile_interval, sample_bytes);
+
+    pthread_mutex_unlock(&profile_mutex);
+
+    // diger threadler en gec PROFILE_OFF_RECHECK_BYTES sonra fark eder, cagiran hemen baslar
+    profile_countdown = profile_next_countdown(sample_bytes);
+    return 0;
+}
+
+// yeni ornek alinmaz, canli ornekler free edildikce dusmeye devam eder ve dump edilebilir
+void heapster_profile_stop(void) {
+    atomic_store(&profile_interval, 0);
+}
+
+size_t heapster_profile_get_sample_bytes(void) {
+    return atomic_load(&profile_interval);
+}
+
+// tek bir frame, collapsed formatta ';' ve ' ' ayirici oldugu icin isimde gecmemeli
+static void profile_write_frame(FILE *out, void *addr) {
+    Dl_info info;
+    if (dladdr(addr, &info) && info.dli_sname) {
+        for (const char *p = info.dli_sname; *p; p++) {
+            fputc((*p == ';' || *p == ' ') ? '_' : *p, out);
+        }
+        return;
+    }
+    if (dladdr(addr, &info) && info.dli_fname) {
+        const char *base = strrchr(info.dli_fname, '/');
+        fprintf(out, "%s+0x%lx", base ? base + 1 : info.dli_fname,
+                (unsigned long)((uintptr_t)addr - (uintptr_t)info.dli_fbase));
+        return;
+    }
+    fprintf(out, "%p", addr);
+}
+
+int heapster_profile_dump(const char *path) {
+    FILE *out = stderr;
+    if (path) {
+        out = fopen(path, "w");
+        if (!out) {
+            fprintf(stderr, "[heapster] profile: cannot open %s\n", path);
+            return -1;
+        }
+    }
+
+    // sample sirasinda frames yazilirken okunmasin diye
+    pthread_mutex_lock(&profile_mutex);
+
+    for (size_t i = 0; i < PROFILE_STACK_SLOTS; i++) {
+        profile_stack_t *s = &profile_stacks[i];
+        uint64_t bytes = atomic_load_explicit(&s->live_bytes, memory_order_relaxed);
+        if (s->hash == 0 || bytes == 0) {
+            continue;
+        }
+
+        // backtrace yapraktan koke, collapsed format kokten yapraga
+        for (int f = s->depth - 1; f >= 0; f--) {
+            profile_write_frame(out, s->frames[f]);
+            if (f > 0) {
+                fputc(';', out);
+            }
+        }
+        if (s->depth == 0) {
+            fputs("[unknown]", out);
+        }
+        fprintf(out, " %llu\n", (unsigned long long)bytes);
+    }
+
+    uint64_t dropped = atomic_load(&profile_dropped);
+
+    pthread_mutex_unlock(&profile_mutex);
+
+    if (dropped) {
+        fprintf(stderr, "[heapster] profile: %llu samples dropped, tables full\n", (unsigned long long)dropped);
+    }
+
+    if (out != stderr) {
+        fclose(out);
+    }
+    return 0;
+}
+
+static void *profile_dumper(void *arg) {
+    (void)arg;
+    char path[sizeof(profile_signal_path) + 32];
+
+    for (;;) {
+        if (sem_wait(&profile_dump_sem) != 0) {
+            continue;  // EINTR
+        }
+        if (profile_signal_path[0]) {
+            snprintf(path, sizeof(path), "%s", profile_signal_path);
+        } else {
+            snprintf(path, sizeof(path), "heapster.%d.folded", (int)getpid());
+        }
+        heapster_profile_dump(path);
+    }
+    return NULL;
+}
+
+// sem_post async-signal-safe, asil dump dumper thread'inde
+static void profile_signal_handler(int signo) {
+    (void)signo;
+    int saved = errno;
+    sem_post(&profile_dump_sem);
+    errno = saved;
+}
+
+int heapster_profile_dump_on_signal(int signo, const char *path) {
+    if (path && strlen(path) >= sizeof(profile_signal_path)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&profile_mutex);
+
+    snprintf(profile_signal_path, sizeof(profile_signal_path), "%s", path ? path : "");
+
+    if (!atomic_load(&profile_dumper_running)) {
+        pthread_t tid;
+        if (sem_init(&profile_dump_sem, 0, 0) != 0 ||
+            pthread_create(&tid, NULL, profile_dumper, NULL) != 0) {
+            pthread_mutex_unlock(&profile_mutex);
+            return -1;
+        }
+        pthread_detach(tid);
+        atomic_store(&profile_dumper_running, 1);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = profile_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    int rc = sigaction(signo, &sa, NULL);
+    if (rc == 0) {
+        profile_signo = signo;
+    }
+
+    pthread_mutex_unlock(&profile_mutex);
+    return rc;
+}
+
+int profile_get_signal(void) {
+    return profile_signo;
+}
+
+void profile_lock(void) {
+    pthread_mutex_lock(&profile_mutex);
+}
+
+void profile_unlock(void) {
+    pthread_mutex_unlock(&profile_mutex);
+}
+
+/*
+child'da dump thread'i yok. handler kurulu kalir ama sem_post'u bekleyen olmaz, child'da da
+sinyalle dump istenirse heapster_profile_dump_on_signal tekrar cagrilmali
+*/
+void profile_reinit_after_fork(void) {
+    pthread_mutex_init(&profile_mutex, NULL);
+    atomic_store(&profile_dumper_running, 0);
+}
@@ -0,0 +1,143 @@
+// reserve.c
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+arena_create hic dokunulmamis hafiza verir, ilk trafik geldiginde her yeni sayfa bir page fault
+demek. heapster_reserve baslangicta istenen kadar heap'i arenalara bolerek alir ve sayfalari
+hemen doldurur:
+
+- tek thread'le: mmap'e MAP_POPULATE verilir, kernel sayfalari tek syscall'da doldurur
+- birden fazla thread'le: arena listeye eklenmeden once sayfalar threadlere bolunup her
+  sayfaya bir kez yazilarak doldurulur (buyuk rezervasyonlarda warmup'i kisaltir)
+- NUMA ya da huge page gerekiyorsa MAP_POPULATE kullanilmaz (mbind / hizalama ondan sonra
+  yapiliyor), sayfalara dokunarak doldurulur
+
+arenalar listeye malloc'un yeni arena olusturmadan once bakacagi sekilde eklenir ve
+is_reserved isaretlenir: bosalinca yok edilmez, purge edilmez. sadece heapster_finalize
+geri verir.
+*/
+
+#define RESERVE_MAX_THREADS 64
+
+typedef struct {
+    volatile char *start;
+    size_t len;
+    size_t page_size;
+} prefault_job_t;
+
+// her sayfaya ayni degeri geri yazar, header'lar bozulmaz ama sayfa yazilabilir olarak faultlanir
+static void *prefault_worker(void *arg) {
+    prefault_job_t *job = arg;
+
+    for (size_t off = 0; off < job->len; off += job->page_size) {
+        job->start[off] = job->start[off];
+    }
+    return NULL;
+}
+
+static void prefault_range(void *addr, size_t len, unsigned threads) {
+    size_t page_size = sysconf(_SC_PAGE_SIZE);
+    size_t pages = (len + page_size - 1) / page_size;
+
+    if (threads > RESERVE_MAX_THREADS) {
+        threads = RESERVE_MAX_THREADS;
+    }
+    if (threads > pages) {
+        threads = (unsigned)pages;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    pthread_t tids[RESERVE_MAX_THREADS];
+    int spawned[RESERVE_MAX_THREADS] = {0};
+    prefault_job_t jobs[RESERVE_MAX_THREADS];
+    size_t per_thread = (pages + threads - 1) / threads;
+
+    for (unsigned i = 0; i < threads; i++) {
+        size_t first = (size_t)i * per_thread;
+        if (first >= pages) {
+            break;
+        }
+        size_t count = pages - first < per_thread ? pages - first : per_thread;
+
+        jobs[i].start = (volatile char *)addr + first * page_size;
+        jobs[i].len = count * page_size;
+        jobs[i].page_size = page_size;
+
+        // ilk parcayi cagiran thread kendisi yapar
+        if (i > 0 && pthread_create(&tids[i], NULL, prefault_worker, &jobs[i]) == 0) {
+            spawned[i] = 1;
+        }
+    }
+
+    // kendi parcamiz + thread acilamayan parcalar burada yapilir
+    for (unsigned i = 0; i < threads && (size_t)i * per_thread < pages; i++) {
+        if (!spawned[i]) {
+            prefault_worker(&jobs[i]);
+        }
+    }
+
+    for (unsigned i = 1; i < threads; i++) {
+        if (spawned[i]) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+}
+
+/*
+bytes kadar heap'i (arenalara bolunmus) alir ve doldurur. arena boyutu config'deki
+max_arena_size'dir (0 ise hepsi tek arena). threads 0 ya da 1 ise MAP_POPULATE, daha fazlaysa
+o kadar thread ile sayfalara dokunulur. 0 basari, -1 hic arena alinamadiysa
+*/
+int heapster_reserve(size_t bytes, unsigned threads) {
+    if (bytes == 0) {
+        return 0;
+    }
+
+    config_ensure_loaded();
+
+    heapster_config_t cfg;
+    heapster_get_config(&cfg);
+
+    size_t chunk = cfg.max_arena_size ? cfg.max_arena_size : bytes;
+    if (chunk < ARENA_MIN_SIZE) {
+        chunk = ARENA_MIN_SIZE;
+    }
+
+    int touch = threads > 1 || numa_mode_enabled() ||
+                (heapster_get_huge_pages() != HEAPSTER_HUGE_OFF && chunk >= HUGE_PAGE_SIZE);
+
+    int flags = ARENA_CREATE_MMAP | ARENA_CREATE_RESERVED | ARENA_CREATE_NO_PUBLISH;
+    if (!touch) {
+        flags |= ARENA_CREATE_POPULATE;
+    }
+
+    size_t reserved = 0;
+    while (reserved < bytes) {
+        size_t size = bytes - reserved < chunk ? bytes - reserved : chunk;
+        if (size < ARENA_MIN_SIZE) {
+            size = ARENA_MIN_SIZE;
+        }
+
+        arena_t *arena = arena_create_ex(&heap_default, size, flags);
+        if (!arena) {
+            break;
+        }
+
+        // listeye girmeden once, kimse henuz bu hafizayi kullanmiyor
+        if (touch) {
+            prefault_range(arena->start, arena->size, threads);
+        }
+
+        arena_publish(arena);
+        reserved += arena->size;
+    }
+
+    return reserved > 0 ? 0 : -1;
+}
@@ -0,0 +1,376 @@
+// rt.c
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+normal yolda malloc uzun bir free list gezebilir, largest_free_block'u bastan hesaplayabilir,
+arena_create icinde sbrk/mmap yapabilir ve free ettigimizde arena sifirlanirken tum arena
+memset edilebilir. ses / trading threadleri icin bunlarin hicbiri kabul edilemez.
+
+bounded latency modu: heapster_rt_reserve ile baslangicta tek bir havuz mmap edilir, sayfalari
+MAP_POPULATE ile hemen doldurulur ve mlock ile swap'a gitmesi engellenir. heapster_rt_enable(1)
+diyen threadin malloc'lari bu havuzdan TLSF (two-level segregated fit) ile verilir:
+
+- size once 2'nin kuvvetine gore (first level) sonra o araligin RT_SL_COUNT esit parcasina
+  gore (second level) bir listeye eslenir
+- iki seviye bitmap tutulur, bos olmayan uygun liste iki ctz ile bulunur, dongu yok
+- free'de sadece fiziksel komsular birlestirilir (prev_phys + size ile O(1))
+
+havuz dolarsa NULL doner, buyumek syscall demek. havuzdaki pointer'lar hangi thread'den
+free edilirse edilsin buraya doner (adres araligi kontrolu).
+havuz tek bir ticket kilit ile korunur: FIFO oldugu icin bekleme sirasi belli.
+*/
+
+#define RT_SL_LOG2   4
+#define RT_SL_COUNT  (1 << RT_SL_LOG2)
+#define RT_FL_MAX    48  // 2^48 byte'a kadar blocklar
+#define RT_ALIGN_LOG2 ((int)__builtin_ctzl(ALIGNMENT))
+#define RT_FL_SHIFT  (RT_SL_LOG2 + RT_ALIGN_LOG2)
+#define RT_FL_COUNT  (RT_FL_MAX - RT_FL_SHIFT + 1)
+#define RT_SMALL_BLOCK ((size_t)1 << RT_FL_SHIFT)  // bunun altindaki boyutlar first level 0'da lineer bolunur
+
+#define RT_MAGIC 0x5EC0DE
+
+typedef struct rt_block {
+    struct rt_block *prev_phys;  // havuzda hemen onceki block, ilk block icin NULL
+    size_t size;                 // payload boyutu
+    int free;
+    uint32_t magic;
+
+    // sadece free iken gecerli, ayni (fl, sl) listesindeki komsular
+    struct rt_block *next_free;
+    struct rt_block *prev_free;
+} rt_block_t;
+
+#define RT_HEADER_SIZE \
+    ((sizeof(rt_block_t) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+#define RT_MIN_PAYLOAD ALIGNMENT
+
+typedef struct {
+    heapster_lock_t lock;
+
+    char *start;
+    char *end;
+
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[RT_FL_COUNT];
+    rt_block_t *heads[RT_FL_COUNT][RT_SL_COUNT];
+
+    size_t used_bytes;
+    size_t free_bytes;
+    int locked_in_ram;  // mlock basarili oldu mu
+} rt_pool_t;
+
+static rt_pool_t rt_pool;
+
+// havuz bir kez kurulur, adres kontrolu kilitsiz yapilir
+static _Atomic(char *) rt_start = NULL;
+static _Atomic(char *) rt_end = NULL;
+
+static _Thread_local int rt_thread_on = 0;
+
+static inline int fls_size(size_t x) {
+    return 63 - __builtin_clzll((unsigned long long)x);
+}
+
+static inline void *rt_payload(rt_block_t *b) {
+    return (char *)b + RT_HEADER_SIZE;
+}
+
+static inline rt_block_t *rt_block(void *payload) {
+    return (rt_block_t *)((char *)payload - RT_HEADER_SIZE);
+}
+
+static inline rt_block_t *rt_next_phys(rt_block_t *b) {
+    return (rt_block_t *)((char *)b + RT_HEADER_SIZE + b->size);
+}
+
+static void rt_mapping(size_t size, int *fl, int *sl) {
+    if (size < RT_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size / (RT_SMALL_BLOCK / RT_SL_COUNT));
+    } else {
+        int f = fls_size(size);
+        *sl = (int)(size >> (f - RT_SL_LOG2)) ^ RT_SL_COUNT;
+        *fl = f - (RT_FL_SHIFT - 1);
+    }
+}
+
+// aramada bir ust sinifa yuvarlanir ki bulunan listedeki her block yetsin
+static size_t rt_round_up(size_t size) {
+    if (size >= RT_SMALL_BLOCK) {
+        size_t round = ((size_t)1 << (fls_size(size) - RT_SL_LOG2)) - 1;
+        size += round;
+    }
+    return size;
+}
+
+static void rt_insert(rt_block_t *b) {
+    int fl, sl;
+    rt_mapping(b->size, &fl, &sl);
+
+    rt_block_t *head = rt_pool.heads[fl][sl];
+    b->free = 1;
+    b->prev_free = NULL;
+    b->next_free = head;
+    if (head) {
+        head->prev_free = b;
+    }
+    rt_pool.heads[fl][sl] = b;
+
+    rt_pool.fl_bitmap |= (uint64_t)1 << fl;
+    rt_pool.sl_bitmap[fl] |= 1u << sl;
+    rt_pool.free_bytes += b->size;
+}
+
+static void rt_remove(rt_block_t *b) {
+    int fl, sl;
+    rt_mapping(b->size, &fl, &sl);
+
+    if (b->prev_free) {
+        b->prev_free->next_free = b->next_free;
+    } else {
+        rt_pool.heads[fl][sl] = b->next_free;
+    }
+    if (b->next_free) {
+        b->next_free->prev_free = b->prev_free;
+    }
+
+    if (!rt_pool.heads[fl][sl]) {
+        rt_pool.sl_bitmap[fl] &= ~(1u << sl);
+        if (!rt_pool.sl_bitmap[fl]) {
+            rt_pool.fl_bitmap &= ~((uint64_t)1 << fl);
+        }
+    }
+
+    b->free = 0;
+    b->next_free = NULL;
+    b->prev_free = NULL;
+    rt_pool.free_bytes -= b->size;
+}
+
+static rt_block_t *rt_find(size_t size) {
+    int fl, sl;
+    rt_mapping(rt_round_up(size), &fl, &sl);
+    if (fl >= RT_FL_COUNT) {
+        return NULL;
+    }
+
+    uint32_t sl_map = rt_pool.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint64_t fl_map = (fl + 1 < 64) ? rt_pool.fl_bitmap & (~(uint64_t)0 << (fl + 1)) : 0;
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = __builtin_ctzll(fl_map);
+        sl_map = rt_pool.sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    return rt_pool.heads[fl][sl];
+}
+
+int rt_owns(const void *ptr) {
+    char *start = atomic_load_explicit(&rt_start, memory_order_acquire);
+    return start && (const char *)ptr >= start &&
+           (const char *)ptr < atomic_load_explicit(&rt_end, memory_order_relaxed);
+}
+
+int rt_thread_enabled(void) {
+    return rt_thread_on;
+}
+
+int heapster_rt_reserve(size_t bytes) {
+    if (atomic_load(&rt_start)) {
+        fprintf(stderr, "[heapster] rt pool already reserved\n");
+        return -1;
+    }
+
+    size_t page_size = sysconf(_SC_PAGE_SIZE);
+    size_t size = (bytes + 2 * RT_HEADER_SIZE + page_size - 1) & ~(page_size - 1);
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+
+    // RLIMIT_MEMLOCK yetmeyebilir, havuz yine de kullanilir ama sayfalar swap'a gidebilir
+    rt_pool.locked_in_ram = mlock(addr, size) == 0;
+    if (!rt_pool.locked_in_ram) {
+        fprintf(stderr, "[heapster] rt pool could not be mlocked, pages may be swapped out\n");
+    }
+#ifndef MAP_POPULATE
+    for (size_t off = 0; off < size; off += page_size) {
+        ((volatile char *)addr)[off] = 0;
+    }
+#endif
+
+    lock_init(&rt_pool.lock, HEAPSTER_LOCK_TICKET);
+    rt_pool.start = addr;
+    rt_pool.end = (char *)addr + size;
+
+    // tek buyuk free block + sonda hic birlesmeyen 0 boyutlu kullanilan sentinel
+    rt_block_t *first = (rt_block_t *)addr;
+    first->prev_phys = NULL;
+    first->size = size - 2 * RT_HEADER_SIZE;
+    first->magic = RT_MAGIC;
+
+    rt_block_t *sentinel = rt_next_phys(first);
+    sentinel->prev_phys = first;
+    sentinel->size = 0;
+    sentinel->free = 0;
+    sentinel->magic = RT_MAGIC;
+
+    rt_insert(first);
+
+    atomic_store_explicit(&rt_end, rt_pool.end, memory_order_relaxed);
+    atomic_store_explicit(&rt_start, rt_pool.start, memory_order_release);
+    return 0;
+}
+
+void heapster_rt_enable(int enabled) {
+    rt_thread_on = enabled && atomic_load(&rt_start) ? 1 : 0;
+}
+
+int heapster_rt_enabled(void) {
+    return rt_thread_on;
+}
+
+void *rt_malloc(size_t size) {
+    if (size == 0 || size > ((size_t)1 << (RT_FL_MAX - 1))) {
+        return NULL;
+    }
+
+    size_t aligned = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+    if (aligned < RT_MIN_PAYLOAD) {
+        aligned = RT_MIN_PAYLOAD;
+    }
+
+    lock_acquire(&rt_pool.lock, NULL);
+
+    rt_block_t *b = rt_find(aligned);
+    if (!b) {
+        lock_release(&rt_pool.lock);
+        return NULL;
+    }
+    rt_remove(b);
+
+    // kalan parca bir block olabilecek kadar buyukse ayrilir ve geri konur
+    if (b->size >= aligned + RT_HEADER_SIZE + RT_MIN_PAYLOAD) {
+        rt_block_t *rest = (rt_block_t *)((char *)b + RT_HEADER_SIZE + aligned);
+        rest->size = b->size - aligned - RT_HEADER_SIZE;
+        rest->prev_phys = b;
+        rest->magic = RT_MAGIC;
+        rt_next_phys(rest)->prev_phys = rest;
+
+        b->size = aligned;
+        rt_insert(rest);
+    }
+
+    rt_pool.used_bytes += b->size;
+    lock_release(&rt_pool.lock);
+
+    return rt_payload(b);
+}
+
+void rt_free(void *ptr) {
+    rt_block_t *b = rt_block(ptr);
+
+    // kontrol kilit altinda, yoksa ayni block'u ayni anda free eden iki thread ikisi de gecer
+    lock_acquire(&rt_pool.lock, NULL);
+
+    if (b->magic != RT_MAGIC || b->free) {
+        lock_release(&rt_pool.lock);
+        fprintf(stderr, "[heapster] invalid rt free %p\n", ptr);
+        return;
+    }
+
+    rt_pool.used_bytes -= b->size;
+
+    // birlesmede yutulan header'in magic'i silinir, eski pointer ile tekrar free edilemesin
+    rt_block_t *next = rt_next_phys(b);
+    if (next->free) {
+        rt_remove(next);
+        b->size += RT_HEADER_SIZE + next->size;
+        rt_next_phys(b)->prev_phys = b;
+        next->magic = 0;
+    }
+
+    rt_block_t *prev = b->prev_phys;
+    if (prev && prev->free) {
+        rt_remove(prev);
+        prev->size += RT_HEADER_SIZE + b->size;
+        rt_next_phys(prev)->prev_phys = prev;
+        b->magic = 0;
+        b = prev;
+    }
+
+    rt_insert(b);
+    lock_release(&rt_pool.lock);
+}
+
+// yeni boyut sigiyorsa yerinde kalir, sigmiyorsa havuzdan yeni yer alinip kopyalanir
+void *rt_realloc(void *ptr, size_t size) {
+    rt_block_t *b = rt_block(ptr);
+
+    if (b->magic != RT_MAGIC || b->free) {
+        fprintf(stderr, "[heapster] invalid rt realloc %p\n", ptr);
+        return NULL;
+    }
+
+    if (size <= b->size) {
+        return ptr;
+    }
+
+    void *new_ptr = rt_malloc(size);
+    if (!new_ptr) {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, b->size);
+    rt_free(ptr);
+    return new_ptr;
+}
+
+void rt_lock(void) {
+    if (atomic_load(&rt_start)) {
+        lock_acquire(&rt_pool.lock, NULL);
+    }
+}
+
+void rt_unlock(void) {
+    if (atomic_load(&rt_start)) {
+        lock_release(&rt_pool.lock);
+    }
+}
+
+void rt_reinit_after_fork(void) {
+    if (atomic_load(&rt_start)) {
+        lock_init(&rt_pool.lock, HEAPSTER_LOCK_TICKET);
+    }
+}
+
+void rt_dump(void) {
+    if (!atomic_load(&rt_start)) {
+        return;
+    }
+
+    lock_acquire(&rt_pool.lock, NULL);
+    printf("===== rt pool =====\n");
+    printf("pool range     : %p - %p\n", (void *)rt_pool.start, (void *)rt_pool.end);
+    printf("used bytes     : %zu\n", rt_pool.used_bytes);
+    printf("free bytes     : %zu\n", rt_pool.free_bytes);
+    printf("mlocked        : %s\n", rt_pool.locked_in_ram ? "yes" : "no");
+    printf("====================\n\n");
+    lock_release(&rt_pool.lock);
+}
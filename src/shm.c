@@ -0,0 +1,370 @@
+// shm.c
+#define _GNU_SOURCE // memfd_create
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+worker process'ler arasinda buyuk mesajlar socket uzerinden kopyalanarak geciyordu. burada
+bir heap shm_open (isimli) ya da memfd_create (isimsiz, fd fork/SCM_RIGHTS ile gecer) ile
+alinan shared memory'de durur, birden fazla process ayni heap'ten allocate/free eder ve
+mesajin kendisi yerine sadece offset'i gonderilir.
+
+mapping duzeni: | shm_header (heap struct'i dahil, 1 sayfa) | arena header | block | ... |
+
+- heap struct'i da shared memory'de, arena->heap her process'te ayni adresi gosterir
+- block header'lari mutlak pointer tutuyor. offset'e cevirmek malloc/free'nin her yolunu
+  degistirirdi, onun yerine her process mapping'i olusturanin adresine map eder (attach bu
+  adres bos degilse basarisiz olur). fork edilen child mapping'i zaten ayni adreste devralir
+- arena kilidi ve heap->list_lock process'ler arasi (lock_init_shared, PROCESS_SHARED mutex,
+  shared futex). remote free kuyrugu kullanilmaz, owner thread baska process'te olabilir
+- heap registry'si process'e ozel (heap->next), shared heap'ler orada degil. attach edilenler
+  burada bir slot dizisinde tutulur, arena_find_by_id ve heapster_status buraya da bakar
+- arena id'si olusturan process'in sayacindan degil, 0x40000000 ustunde rastgele secilir ki
+  attach eden process'in kendi arenalariyla cakismasin
+- heap sabit boyutlu, arena hic purge/destroy edilmez. bir process kilidi tutarken olurse
+  kilit kalir (robust mutex yok), diger process'ler bekler
+*/
+
+#define SHM_MAGIC        0x4d48535245545350ULL  // "PSTERSHM"
+#define SHM_VERSION      1
+#define SHM_MAX_HEAPS    64
+#define SHM_ARENA_ID_BIT 0x40000000u
+
+typedef struct shm_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t arena_header_size;
+    uint32_t block_header_size;
+    uint32_t alignment;
+
+    uint64_t size;              // mapping boyutu
+    uint64_t base;              // her process'in map etmesi gereken adres
+    _Atomic uint32_t ready;     // olusturan heap'i kurdu, attach edilebilir
+
+    struct heapster_heap heap;  // tum process'lerde ayni adreste
+} shm_header_t;
+
+// bu process'te attach edilmis heap'ler. okuyucular (arena_find_by_id) kilitsiz, epoch icinde gezer
+static _Atomic(heapster_heap_t *) shm_heaps[SHM_MAX_HEAPS];
+static int shm_fds[SHM_MAX_HEAPS];
+
+static size_t shm_page_size(void) {
+    return (size_t)sysconf(_SC_PAGE_SIZE);
+}
+
+static shm_header_t *shm_header_of(heapster_heap_t *heap) {
+    return (shm_header_t *)((char *)heap - offsetof(shm_header_t, heap));
+}
+
+static int shm_register(heapster_heap_t *heap, int fd) {
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *expected = NULL;
+        if (atomic_load(&shm_heaps[i]) != NULL) {
+            continue;
+        }
+        shm_fds[i] = fd;
+        if (atomic_compare_exchange_strong(&shm_heaps[i], &expected, heap)) {
+            return 0;
+        }
+    }
+    fprintf(stderr, "[heapster] shared heap: more than %d heaps attached\n", SHM_MAX_HEAPS);
+    return -1;
+}
+
+// caller epoch_enter / epoch_exit arasinda olmali
+arena_t *shm_find_arena(uint64_t id) {
+    if (!(id & SHM_ARENA_ID_BIT)) {
+        return NULL;
+    }
+
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *heap = atomic_load_explicit(&shm_heaps[i], memory_order_acquire);
+        if (!heap) {
+            continue;
+        }
+        for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+            if (arena->id == id) {
+                return arena;
+            }
+        }
+    }
+    return NULL;
+}
+
+// heapster_status icin, caller okuma bolumunde
+void shm_dump(void) {
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *heap = atomic_load_explicit(&shm_heaps[i], memory_order_acquire);
+        if (heap) {
+            heap_dump(heap);
+        }
+    }
+}
+
+static uint32_t shm_new_arena_id(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t h = ((uint64_t)getpid() << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)ts.tv_sec << 20);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    uint32_t id;
+    do {
+        id = SHM_ARENA_ID_BIT | (uint32_t)(h & (SHM_ARENA_ID_BIT - 1));
+        h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+    } while (shm_find_arena(id) != NULL);
+
+    return id;
+}
+
+heapster_heap_t *heapster_heap_create_shared(const char *name, size_t size) {
+    size_t page_size = shm_page_size();
+
+    fork_handlers_install();
+
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)
+                  : memfd_create("heapster", MFD_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "[heapster] create_shared: cannot create %s\n", name ? name : "memfd");
+        return NULL;
+    }
+
+    if (size < page_size + ARENA_MIN_SIZE) {
+        size = page_size + ARENA_MIN_SIZE;
+    }
+    size = (size + page_size - 1) & ~(page_size - 1);
+
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[heapster] create_shared: cannot map %zu bytes\n", size);
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    shm_header_t *header = map;
+    memset(header, 0, sizeof(*header));
+
+    heapster_heap_t *heap = &header->heap;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&heap->list_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    heap->deferred_coalesce_default = heap_default.deferred_coalesce_default;
+    config_apply_to_heap(heap, NULL);
+    heap->fixed_size = 1;
+    heap->is_shared = 1;
+    strncpy(heap->name, "shared", sizeof(heap->name) - 1);
+
+    epoch_enter();
+    uint32_t id = shm_new_arena_id();
+    epoch_exit();
+
+    arena_t *arena = arena_format(heap, (char *)map + page_size, size - page_size);
+    if (!arena) {
+        munmap(map, size);
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    // arena_format yerel sayactan id verdi ve ilk block'a yazdi, kimse henuz gormedi
+    arena->id = id;
+    arena->free_list_head->arena_id = (int)id;
+    arena->is_shared = 1;
+    lock_init_shared(&arena->lock, arena->lock.kind);
+    arena_publish(arena);
+
+    header->magic = SHM_MAGIC;
+    header->version = SHM_VERSION;
+    header->arena_header_size = ARENA_HEADER_SIZE;
+    header->block_header_size = BLOCK_HEADER_SIZE;
+    header->alignment = ALIGNMENT;
+    header->size = size;
+    header->base = (uint64_t)(uintptr_t)map;
+    atomic_store_explicit(&header->ready, 1, memory_order_release);
+
+    if (shm_register(heap, fd) != 0) {
+        munmap(map, size);
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    return heap;
+}
+
+// fd'nin sahipligi alinir (basarisizlikta kapatilir)
+static heapster_heap_t *shm_attach_fd(int fd) {
+    shm_header_t peek;
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || pread(fd, &peek, offsetof(shm_header_t, ready), 0) != (ssize_t)offsetof(shm_header_t, ready)) {
+        close(fd);
+        return NULL;
+    }
+
+    if (peek.magic != SHM_MAGIC || peek.version != SHM_VERSION || peek.size != (uint64_t)st.st_size ||
+        peek.arena_header_size != ARENA_HEADER_SIZE || peek.block_header_size != BLOCK_HEADER_SIZE ||
+        peek.alignment != ALIGNMENT) {
+        fprintf(stderr, "[heapster] attach_shared: not a heapster shared heap (or a different build)\n");
+        close(fd);
+        return NULL;
+    }
+
+    void *base = (void *)(uintptr_t)peek.base;
+
+    // ayni heap bu process'te zaten map edilmisse (fork'tan devralinmis gibi) o kullanilir
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *heap = atomic_load(&shm_heaps[i]);
+        if (heap && (void *)shm_header_of(heap) == base) {
+            close(fd);
+            return heap;
+        }
+    }
+
+    void *map = mmap(base, peek.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (map != base) {
+        fprintf(stderr, "[heapster] attach_shared: address %p is not free in this process\n", base);
+        munmap(map, peek.size);
+        close(fd);
+        return NULL;
+    }
+
+    shm_header_t *header = map;
+    if (!atomic_load_explicit(&header->ready, memory_order_acquire)) {
+        munmap(map, peek.size);
+        close(fd);
+        return NULL;
+    }
+
+    if (shm_register(&header->heap, fd) != 0) {
+        munmap(map, peek.size);
+        close(fd);
+        return NULL;
+    }
+    return &header->heap;
+}
+
+heapster_heap_t *heapster_heap_attach_shared(const char *name, int fd) {
+    fork_handlers_install();
+
+    if (name) {
+        fd = shm_open(name, O_RDWR, 0);
+    } else if (fd >= 0) {
+        fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);  // caller'in fd'si ona kalir
+    }
+    if (fd < 0) {
+        fprintf(stderr, "[heapster] attach_shared: cannot open %s\n", name ? name : "fd");
+        return NULL;
+    }
+    return shm_attach_fd(fd);
+}
+
+int heapster_heap_shared_fd(heapster_heap_t *heap) {
+    if (!heap || !heap->is_shared) {
+        return -1;
+    }
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        if (atomic_load(&shm_heaps[i]) == heap) {
+            return shm_fds[i];
+        }
+    }
+    return -1;
+}
+
+/*
+bu process'in mapping'ini birakir, heap digerleri icin yasamaya devam eder (isimliyse ismi
+shm_unlink edilene kadar). okuyucular slotu bosaltmadan once gorduyse cikmalari beklenir.
+okuma bolumu icinden cagrilmamali
+*/
+void heapster_heap_detach_shared(heapster_heap_t *heap) {
+    if (!heap || !heap->is_shared) {
+        return;
+    }
+
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *expected = heap;
+        if (!atomic_compare_exchange_strong(&shm_heaps[i], &expected, NULL)) {
+            continue;
+        }
+
+        epoch_synchronize(epoch_advance());
+
+        shm_header_t *header = shm_header_of(heap);
+        munmap(header, header->size);
+        close(shm_fds[i]);
+        return;
+    }
+}
+
+void shm_detach_all(void) {
+    for (int i = 0; i < SHM_MAX_HEAPS; i++) {
+        heapster_heap_t *heap = atomic_load(&shm_heaps[i]);
+        if (heap) {
+            heapster_heap_detach_shared(heap);
+        }
+    }
+}
+
+// mapping'in basi ve boyutu: shared heap'lerde shm_header, dosya heap'lerinde dosya basi
+static char *heap_map_base(heapster_heap_t *heap, size_t *size) {
+    if (heap->is_shared) {
+        shm_header_t *header = shm_header_of(heap);
+        *size = header->size;
+        return (char *)header;
+    }
+    if (heap->file) {
+        *size = heap->file_size;
+        return (char *)heap->file;
+    }
+    return NULL;
+}
+
+size_t heapster_heap_to_offset(heapster_heap_t *heap, const void *ptr) {
+    size_t size = 0;
+    char *base = heap ? heap_map_base(heap, &size) : NULL;
+
+    if (!base || !ptr || (const char *)ptr < base || (const char *)ptr >= base + size) {
+        return 0;
+    }
+    return (size_t)((const char *)ptr - base);
+}
+
+void *heapster_heap_from_offset(heapster_heap_t *heap, size_t offset) {
+    size_t size = 0;
+    char *base = heap ? heap_map_base(heap, &size) : NULL;
+
+    if (!base || offset == 0 || offset >= size) {
+        return NULL;
+    }
+    return base + offset;
+}
@@ -1,5 +1,7 @@
+#define _GNU_SOURCE // sched_getcpu
 #include <string.h>
 #include <stdio.h>
+#include <sched.h>
 
 #include "stats.h"
 #include "internal.h"
@@ -10,10 +12,119 @@ void arena_stats_reset(arena_t *arena) {
         return;
     }
     memset(&arena->stats, 0, sizeof(arena->stats));
+
+    for (int i = 0; i < ARENA_COUNTER_SHARDS; i++) {
+        for (int c = 0; c < ARENA_COUNTER_COUNT; c++) {
+            atomic_store_explicit(&arena->counters[i].value[c], 0, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+her thread calistigi CPU'nun shard'ina yazar, ayni CPU'daki threadler zaten ayni cache'i
+paylasiyor. sched_getcpu vDSO uzerinden calisir (syscall yok), hata verirse thread'e
+sabit bir shard verilir
+*/
+static inline int counter_shard(void) {
+    static _Thread_local int fallback_shard = -1;
+
+    int cpu = sched_getcpu();
+    if (cpu >= 0) {
+        return cpu % ARENA_COUNTER_SHARDS;
+    }
+
+    if (fallback_shard < 0) {
+        static _Atomic int next_shard = 0;
+        fallback_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % ARENA_COUNTER_SHARDS;
+    }
+    return fallback_shard;
+}
+
+// lock gerektirmez, delta negatif olabilir (calloc'un malloc sayacini geri almasi gibi)
+void arena_counter_add(arena_t *arena, arena_counter_t counter, int64_t delta) {
+    if (!arena) {
+        return;
+    }
+    atomic_fetch_add_explicit(&arena->counters[counter_shard()].value[counter],
+                              (uint64_t)delta, memory_order_relaxed);
+}
+
+uint64_t arena_counter_sum(arena_t *arena, arena_counter_t counter) {
+    uint64_t sum = 0;
+    for (int i = 0; i < ARENA_COUNTER_SHARDS; i++) {
+        sum += atomic_load_explicit(&arena->counters[i].value[counter], memory_order_relaxed);
+    }
+    return sum;
+}
+
+// arena->stats'in kopyasi, cagri sayaclari shardlardan toplanmis halde. byte statlari tutarli olsun diye caller lock tutmali
+void arena_stats_snapshot(arena_t *arena, heapster_stats_t *out) {
+    if (!arena || !out) {
+        return;
+    }
+
+    *out = arena->stats;
+    out->malloc_calls  = arena_counter_sum(arena, ARENA_COUNTER_MALLOC);
+    out->free_calls    = arena_counter_sum(arena, ARENA_COUNTER_FREE);
+    out->realloc_calls = arena_counter_sum(arena, ARENA_COUNTER_REALLOC);
+    out->calloc_calls  = arena_counter_sum(arena, ARENA_COUNTER_CALLOC);
 }
 
-// tum arenalari tarayip global stats hesapla
-void heapster_stats_update_global(heapster_stats_t *global_stats) {
-    
+// heap'in tum arenalarini tarayip heap toplamini hesapla
+void heapster_stats_update_global(heapster_heap_t *heap, heapster_stats_t *global_stats) {
+    if (!global_stats) {
+        return;
+    }
+
+    memset(global_stats, 0, sizeof(*global_stats));
+
+    // liste kilitsiz geziliyor, okuma bolumu arenalarin altimizdan unmap edilmesini engeller
+    epoch_enter();
+
+    for (arena_t *arena = arena_get_list(heap); arena; arena = arena->next) {
+        heapster_stats_t snap;
+
+        arena_lock(arena);
+        arena_stats_snapshot(arena, &snap);
+        arena_unlock(arena);
+
+        // kernel'den okunur, arena kilidi disinda
+        snap.huge_bytes = arena_huge_backed_bytes(arena);
+
+        global_stats->total_bytes           += snap.total_bytes;
+        global_stats->free_bytes            += snap.free_bytes;
+        global_stats->used_bytes            += snap.used_bytes;
+        global_stats->free_block_count      += snap.free_block_count;
+        global_stats->allocated_block_count += snap.allocated_block_count;
+        global_stats->wasted_bytes          += snap.wasted_bytes;
+        global_stats->huge_bytes            += snap.huge_bytes;
+        global_stats->purged_bytes          += snap.purged_bytes;
+
+        if (snap.largest_free_block > global_stats->largest_free_block) {
+            global_stats->largest_free_block = snap.largest_free_block;
+        }
+
+        global_stats->malloc_calls      += snap.malloc_calls;
+        global_stats->free_calls        += snap.free_calls;
+        global_stats->realloc_calls     += snap.realloc_calls;
+        global_stats->calloc_calls      += snap.calloc_calls;
+        global_stats->quick_hits        += snap.quick_hits;
+        global_stats->consolidations    += snap.consolidations;
+        global_stats->remote_free_calls += snap.remote_free_calls;
+        global_stats->lock_contended    += snap.lock_contended;
+        global_stats->lock_wait_ns      += snap.lock_wait_ns;
+        global_stats->policy_searches     += snap.policy_searches;
+        global_stats->policy_search_steps += snap.policy_search_steps;
+        global_stats->policy_switches     += snap.policy_switches;
+        global_stats->free_list_steps     += snap.free_list_steps;
+
+    }
+
+    epoch_exit();
+
+    if (global_stats->free_bytes > 0) {
+        global_stats->fragmentation_ratio =
+            1.0 - ((double)global_stats->largest_free_block / global_stats->free_bytes);
+    }
 }
 
@@ -0,0 +1,182 @@
+// tcache.c
+#include <string.h>
+
+#include "internal.h"
+#include "internal_f.h"
+#include "heapster.h"
+
+/*
+Bu dosya ne ise yarar?
+cagri yerlerinin cogu heapster_malloc(sizeof(T)) diyor ama her cagri hizalama, arena secimi,
+arena kilidi ve policy aramasindan geciyordu. burada varsayilan heap icin thread basina bir
+kucuk block cache'i var:
+
+- size class'lari ALIGNMENT'in katlari: class c -> payload (c + 1) * ALIGNMENT, toplam
+  HEAPSTER_SIZE_CLASSES tane (public header'daki HEAPSTER_SIZE_CLASS derleme aninda hesaplar)
+- free edilen kucuk block arenaya donmez, thread'in o class'taki LIFO listesine girer
+  (block->next ile bagli, en fazla tcache_count tane). ayni class'taki bir sonraki malloc onu
+  kilitsiz ve aramasiz geri alir. liste doluysa free normal yoldan gider
+- cache'teki block arena acisindan hala allocated: coalesce edilmez, arena onu tutarken bos
+  sayilmaz. block->free = BLOCK_TCACHE, boylece ikinci free (double free) ve cache'teki
+  pointer'a realloc block_validate'te reddedilir
+- requested_size, wasted stat'i ve arena'nin malloc/free sayaclari cache isabetlerinde
+  degismez, block arenaya dondugunde ilk allocation'daki haliyle hesaplanir
+- thread cikarken (pthread key destructor) cache arenalara geri verilir. finalize tum
+  arenalari geri verdiginde generation artar, diger threadler eski cache'lerini kullanmadan
+  birakir
+- integrity check, profiler'in ornekleyecegi allocation, rt modu ve NUMA modu cache'i atlar:
+  hepsinin malloc/free'de yapilmasi gereken kendi isleri var
+*/
+
+// HEAPSTER_ALIGNMENT public header'da derleme aninda size class'i hesaplamak icin
+_Static_assert(HEAPSTER_ALIGNMENT == ALIGNMENT, "public and internal alignment differ");
+
+#define TCACHE_MAX_SIZE ((size_t)HEAPSTER_SIZE_CLASSES * ALIGNMENT)
+
+typedef struct {
+    block_header_t *bins[HEAPSTER_SIZE_CLASSES];
+    unsigned counts[HEAPSTER_SIZE_CLASSES];
+    unsigned generation;  // tcache_generation'dan farkliysa icerik gecersiz
+    int registered;       // thread cikisinda flush icin key set edildi
+} tcache_t;
+
+static _Thread_local tcache_t tcache;
+
+static _Atomic unsigned tcache_count = 32;
+static _Atomic unsigned tcache_generation = 1;
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+void heapster_set_tcache_count(unsigned count) {
+    atomic_store(&tcache_count, count);
+    if (count == 0) {
+        heapster_tcache_flush();
+    }
+}
+
+unsigned heapster_get_tcache_count(void) {
+    return atomic_load(&tcache_count);
+}
+
+int heapster_size_class(size_t size) {
+    return HEAPSTER_SIZE_CLASS(size);
+}
+
+// bu thread'in cache'i gecersizse 1, eski generation'in blocklari unutulur (arenalari yok artik)
+static inline int tcache_stale(void) {
+    unsigned gen = atomic_load_explicit(&tcache_generation, memory_order_acquire);
+    if (__builtin_expect(tcache.generation != gen, 0)) {
+        memset(tcache.bins, 0, sizeof(tcache.bins));
+        memset(tcache.counts, 0, sizeof(tcache.counts));
+        tcache.generation = gen;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+cls class'indan bir block, yoksa NULL (caller normal malloc yoluna gider). size istenen boyut,
+profiler sayaci icin. caller heap'in varsayilan heap oldugunu biliyor
+*/
+void *tcache_malloc(int cls, size_t size) {
+    block_header_t *block = tcache.bins[cls];
+    if (!block || tcache_stale()) {
+        return NULL;
+    }
+
+    // bunlarin her biri kendi yolunu ister, nadiren aciklar
+    if (__builtin_expect(atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF ||
+                         profile_countdown - (int64_t)size < 0 ||
+                         rt_thread_enabled() || numa_mode_enabled(), 0)) {
+        return NULL;
+    }
+
+    tcache.bins[cls] = block->next;
+    tcache.counts[cls]--;
+    profile_countdown -= (int64_t)size;
+
+    block->next = NULL;
+    block->free = 0;
+    return block_to_payload(block);
+}
+
+static void tcache_destructor(void *arg) {
+    (void)arg;
+    heapster_tcache_flush();
+}
+
+static void tcache_key_create(void) {
+    pthread_key_create(&tcache_key, tcache_destructor);
+}
+
+/*
+heap_free'den, block varsayilan heap'in (shared olmayan) arenasinda ve gecerli. 1 = cache'e
+girdi, free bitti. 0 = normal yoldan free edilmeli
+*/
+int tcache_free(block_header_t *block) {
+    if (block->size > TCACHE_MAX_SIZE || block->check != 0 ||
+        atomic_load_explicit(&check_level, memory_order_relaxed) != HEAPSTER_CHECK_OFF) {
+        return 0;
+    }
+
+    unsigned max = atomic_load_explicit(&tcache_count, memory_order_relaxed);
+    int cls = (int)(block->size / ALIGNMENT) - 1;
+
+    tcache_stale();
+    if (tcache.counts[cls] >= max || numa_mode_enabled()) {
+        return 0;
+    }
+
+    if (__builtin_expect(!tcache.registered, 0)) {
+        pthread_once(&tcache_key_once, tcache_key_create);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = 1;
+    }
+
+    block->free = BLOCK_TCACHE;
+    block->next = tcache.bins[cls];
+    tcache.bins[cls] = block;
+    tcache.counts[cls]++;
+    return 1;
+}
+
+// bu thread'in cache'indeki her block arenasina geri verilir
+void heapster_tcache_flush(void) {
+    if (tcache_stale()) {
+        return;
+    }
+
+    for (int cls = 0; cls < HEAPSTER_SIZE_CLASSES; cls++) {
+        block_header_t *block = tcache.bins[cls];
+        tcache.bins[cls] = NULL;
+        tcache.counts[cls] = 0;
+
+        while (block) {
+            block_header_t *next = block->next;
+            block->next = NULL;
+            block->free = 0;
+            heap_free_direct(block_to_payload(block));
+            block = next;
+        }
+    }
+}
+
+// heap_release_all'dan: cagiran thread'inki hemen, digerlerininki bir sonraki kullanimda birakilir
+void tcache_invalidate_all(void) {
+    atomic_fetch_add(&tcache_generation, 1);
+    tcache_stale();
+}
+
+// bu thread'in cache'indeki block sayisi, heapster_status icin
+size_t tcache_cached_blocks(void) {
+    if (tcache_stale()) {
+        return 0;
+    }
+
+    size_t total = 0;
+    for (int cls = 0; cls < HEAPSTER_SIZE_CLASSES; cls++) {
+        total += tcache.counts[cls];
+    }
+    return total;
+}
@@ -0,0 +1,340 @@
+// tree.c
+#include <stddef.h>
+
+#include "internal.h"
+#include "internal_f.h"
+
+/*
+Bu dosya ne ise yarar?
+Free list adres sirali tutuluyor (first fit ve coalescing icin). best fit ve worst fit ise
+boyuta gore arama istiyor ve liste uzerinde her seferinde tum listeyi taramak zorunda kaliyordu.
+Burada her arena icin free blocklarin (size, adres) anahtarli bir red-black tree'si tutulur:
+
+insert / remove  -> O(log n)
+best fit         -> O(log n), size'a esit ya da buyuk en kucuk anahtar (lower bound)
+worst fit        -> O(1), en buyuk anahtar arena->free_tree_max'ta hazir durur
+
+free list ile tree her zaman birlikte guncellenir (block_add_to_free_list / block_remove_from_free_list)
+o yuzden bir block tree'deyken size'i degistirilmemelidir, once cikarilip sonra tekrar eklenir.
+
+NULL cocuklar siyah kabul edilir, ayri bir sentinel dugum yok cunku dugumler blocklarin icinde.
+*/
+
+static inline free_tree_node_t *tnode(block_header_t *b) {
+    return (free_tree_node_t *)((char *)b + BLOCK_HEADER_SIZE);
+}
+
+static inline int is_red(block_header_t *b) {
+    return b && tnode(b)->red;
+}
+
+static inline int key_less(block_header_t *a, block_header_t *b) {
+    return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static void rotate_left(arena_t *arena, block_header_t *x) {
+    free_tree_node_t *xn = tnode(x);
+    block_header_t *y = xn->right;
+    free_tree_node_t *yn = tnode(y);
+
+    xn->right = yn->left;
+    if (yn->left) {
+        tnode(yn->left)->parent = x;
+    }
+
+    yn->parent = xn->parent;
+    if (!xn->parent) {
+        arena->free_tree_root = y;
+    } else if (tnode(xn->parent)->left == x) {
+        tnode(xn->parent)->left = y;
+    } else {
+        tnode(xn->parent)->right = y;
+    }
+
+    yn->left = x;
+    xn->parent = y;
+}
+
+static void rotate_right(arena_t *arena, block_header_t *x) {
+    free_tree_node_t *xn = tnode(x);
+    block_header_t *y = xn->left;
+    free_tree_node_t *yn = tnode(y);
+
+    xn->left = yn->right;
+    if (yn->right) {
+        tnode(yn->right)->parent = x;
+    }
+
+    yn->parent = xn->parent;
+    if (!xn->parent) {
+        arena->free_tree_root = y;
+    } else if (tnode(xn->parent)->right == x) {
+        tnode(xn->parent)->right = y;
+    } else {
+        tnode(xn->parent)->left = y;
+    }
+
+    yn->right = x;
+    xn->parent = y;
+}
+
+// u'nun yerine v'yi (NULL olabilir) parent'a baglar
+static void transplant(arena_t *arena, block_header_t *u, block_header_t *v) {
+    block_header_t *p = tnode(u)->parent;
+
+    if (!p) {
+        arena->free_tree_root = v;
+    } else if (tnode(p)->left == u) {
+        tnode(p)->left = v;
+    } else {
+        tnode(p)->right = v;
+    }
+
+    if (v) {
+        tnode(v)->parent = p;
+    }
+}
+
+void free_tree_reset(arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+    arena->free_tree_root = NULL;
+    arena->free_tree_max = NULL;
+    arena->tiny_free_count = 0;
+}
+
+void free_tree_insert(arena_t *arena, block_header_t *block) {
+    if (!arena || !block) {
+        return;
+    }
+
+    if (block->size < FREE_TREE_MIN_SIZE) {
+        arena->tiny_free_count++;
+        return;
+    }
+
+    free_tree_node_t *n = tnode(block);
+    n->left = NULL;
+    n->right = NULL;
+    n->red = 1;
+
+    block_header_t *parent = NULL;
+    block_header_t *cur = arena->free_tree_root;
+    while (cur) {
+        parent = cur;
+        cur = key_less(block, cur) ? tnode(cur)->left : tnode(cur)->right;
+    }
+
+    n->parent = parent;
+    if (!parent) {
+        arena->free_tree_root = block;
+    } else if (key_less(block, parent)) {
+        tnode(parent)->left = block;
+    } else {
+        tnode(parent)->right = block;
+    }
+
+    if (!arena->free_tree_max || key_less(arena->free_tree_max, block)) {
+        arena->free_tree_max = block;
+    }
+
+    // kirmizi-kirmizi ihlalini yukari dogru duzelt
+    block_header_t *z = block;
+    while (is_red(tnode(z)->parent)) {
+        block_header_t *p = tnode(z)->parent;
+        block_header_t *g = tnode(p)->parent;
+
+        if (tnode(g)->left == p) {
+            block_header_t *u = tnode(g)->right;
+            if (is_red(u)) {
+                tnode(p)->red = 0;
+                tnode(u)->red = 0;
+                tnode(g)->red = 1;
+                z = g;
+            } else {
+                if (tnode(p)->right == z) {
+                    z = p;
+                    rotate_left(arena, z);
+                    p = tnode(z)->parent;
+                }
+                tnode(p)->red = 0;
+                tnode(g)->red = 1;
+                rotate_right(arena, g);
+            }
+        } else {
+            block_header_t *u = tnode(g)->left;
+            if (is_red(u)) {
+                tnode(p)->red = 0;
+                tnode(u)->red = 0;
+                tnode(g)->red = 1;
+                z = g;
+            } else {
+                if (tnode(p)->left == z) {
+                    z = p;
+                    rotate_right(arena, z);
+                    p = tnode(z)->parent;
+                }
+                tnode(p)->red = 0;
+                tnode(g)->red = 1;
+                rotate_left(arena, g);
+            }
+        }
+    }
+
+    tnode(arena->free_tree_root)->red = 0;
+}
+
+void free_tree_remove(arena_t *arena, block_header_t *z) {
+    if (!arena || !z) {
+        return;
+    }
+
+    if (z->size < FREE_TREE_MIN_SIZE) {
+        if (arena->tiny_free_count > 0) {
+            arena->tiny_free_count--;
+        }
+        return;
+    }
+
+    // max cikiyorsa yeni max onun in-order onculudur. max'in sag cocugu olmaz
+    if (arena->free_tree_max == z) {
+        block_header_t *pred = tnode(z)->left;
+        if (pred) {
+            while (tnode(pred)->right) {
+                pred = tnode(pred)->right;
+            }
+        } else {
+            pred = tnode(z)->parent;
+        }
+        arena->free_tree_max = pred;
+    }
+
+    block_header_t *y = z;
+    int y_red = tnode(y)->red;
+    block_header_t *x = NULL;
+    block_header_t *x_parent = NULL;
+
+    if (!tnode(z)->left) {
+        x = tnode(z)->right;
+        x_parent = tnode(z)->parent;
+        transplant(arena, z, x);
+    } else if (!tnode(z)->right) {
+        x = tnode(z)->left;
+        x_parent = tnode(z)->parent;
+        transplant(arena, z, x);
+    } else {
+        // iki cocuk var, yerine sag alt agacin en kucugu gecer
+        y = tnode(z)->right;
+        while (tnode(y)->left) {
+            y = tnode(y)->left;
+        }
+        y_red = tnode(y)->red;
+        x = tnode(y)->right;
+
+        if (tnode(y)->parent == z) {
+            x_parent = y;
+        } else {
+            x_parent = tnode(y)->parent;
+            transplant(arena, y, x);
+            tnode(y)->right = tnode(z)->right;
+            tnode(tnode(y)->right)->parent = y;
+        }
+
+        transplant(arena, z, y);
+        tnode(y)->left = tnode(z)->left;
+        tnode(tnode(y)->left)->parent = y;
+        tnode(y)->red = tnode(z)->red;
+    }
+
+    // siyah bir dugum ciktiysa x tarafinda eksik kalan siyahi telafi et
+    if (!y_red) {
+        while (x != arena->free_tree_root && !is_red(x)) {
+            if (x == tnode(x_parent)->left) {
+                block_header_t *w = tnode(x_parent)->right;
+                if (is_red(w)) {
+                    tnode(w)->red = 0;
+                    tnode(x_parent)->red = 1;
+                    rotate_left(arena, x_parent);
+                    w = tnode(x_parent)->right;
+                }
+                if (!is_red(tnode(w)->left) && !is_red(tnode(w)->right)) {
+                    tnode(w)->red = 1;
+                    x = x_parent;
+                    x_parent = tnode(x)->parent;
+                } else {
+                    if (!is_red(tnode(w)->right)) {
+                        tnode(tnode(w)->left)->red = 0;
+                        tnode(w)->red = 1;
+                        rotate_right(arena, w);
+                        w = tnode(x_parent)->right;
+                    }
+                    tnode(w)->red = tnode(x_parent)->red;
+                    tnode(x_parent)->red = 0;
+                    tnode(tnode(w)->right)->red = 0;
+                    rotate_left(arena, x_parent);
+                    x = arena->free_tree_root;
+                    x_parent = NULL;
+                }
+            } else {
+                block_header_t *w = tnode(x_parent)->left;
+                if (is_red(w)) {
+                    tnode(w)->red = 0;
+                    tnode(x_parent)->red = 1;
+                    rotate_right(arena, x_parent);
+                    w = tnode(x_parent)->left;
+                }
+                if (!is_red(tnode(w)->right) && !is_red(tnode(w)->left)) {
+                    tnode(w)->red = 1;
+                    x = x_parent;
+                    x_parent = tnode(x)->parent;
+                } else {
+                    if (!is_red(tnode(w)->left)) {
+                        tnode(tnode(w)->right)->red = 0;
+                        tnode(w)->red = 1;
+                        rotate_left(arena, w);
+                        w = tnode(x_parent)->left;
+                    }
+                    tnode(w)->red = tnode(x_parent)->red;
+                    tnode(x_parent)->red = 0;
+                    tnode(tnode(w)->left)->red = 0;
+                    rotate_right(arena, x_parent);
+                    x = arena->free_tree_root;
+                    x_parent = NULL;
+                }
+            }
+        }
+        if (x) {
+            tnode(x)->red = 0;
+        }
+    }
+
+    tnode(z)->left = NULL;
+    tnode(z)->right = NULL;
+    tnode(z)->parent = NULL;
+}
+
+/*
+size'a esit ya da buyuk en kucuk block, esitlik durumunda en dusuk adresli olan.
+tiny blocklar burada yok, onlara policy tarafinda bakilir. steps'e gezilen node sayisi eklenir
+*/
+block_header_t *free_tree_lower_bound(arena_t *arena, size_t size, uint64_t *steps) {
+    if (!arena) {
+        return NULL;
+    }
+
+    block_header_t *best = NULL;
+    block_header_t *cur = arena->free_tree_root;
+
+    while (cur) {
+        (*steps)++;
+        if (cur->size >= size) {
+            best = cur;
+            cur = tnode(cur)->left;
+        } else {
+            cur = tnode(cur)->right;
+        }
+    }
+
+    return best;
+}